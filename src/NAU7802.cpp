@@ -21,13 +21,88 @@
 */
 
 #include "NAU7802.h"
+#include "NAU7802_IIO.h"
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+
+//One open /dev/i2c-N shared by every NAU7802 on that adapter
+//I2C_SLAVE, the mux channel and the transfer after them are separate syscalls, so every
+//route() and the transaction it sets up run under lock.
+typedef struct
+{
+  int fd;
+  uint16_t users;
+  uint16_t address; //Last I2C_SLAVE address set on fd
+  NAU7802_Mux *mux; //Mux that may have a channel enabled, nullptr if none
+  std::mutex lock;  //Held from route() to the end of the transaction
+} NAU7802_Adapter;
+
+static NAU7802_Adapter adapters[256];
+static std::mutex adapterLock;
+
+//Shared time base for millis() and micros()
+static const std::chrono::steady_clock::time_point refTime = std::chrono::steady_clock::now();
+
+//State the per-read path never touches, kept out of the object so devices pack densely
+struct NAU7802::Cold
+{
+  NAU7802_Tare tares[NAU7802_TARE_SLOTS];
+  uint8_t activeTare;
+  uint8_t powerProfile;     //Last profile written by setPowerProfile()
+  uint8_t calMode;          //CALMOD of the calibration started last
+  int32_t systemOffset[2];  //Part of OCAL above the internal offset, per channel
+  bool systemOffsetSet[2];  //calibrateSystemOffset() succeeded on the channel
+  bool chopping;            //getAverage() uses getChoppedReading()
+  bool chopInverted;        //Current state of PGA INV
+  uint8_t chopSettle;       //Conversions discarded after a polarity flip
+};
 
 //Constructor
 NAU7802::NAU7802(uint8_t i2c_bus, uint8_t i2c_addr)
 {
     this->i2c_addr = i2c_addr;
     this-> i2c_bus = i2c_bus;
-    refTime = std::chrono::steady_clock::now();
+    _zeroOffset = 0;
+    _calibrationFactor = 1.0;
+    _deviceTag = 0;
+    _channel = NAU7802_CHANNEL_1;
+    _sampleRate = NAU7802_SPS_10; // Power on default
+    _gain = NAU7802_GAIN_1;
+    _cold = new Cold;
+    _cold->powerProfile = NAU7802_PROFILE_LOW_NOISE; // Power on default
+    _cold->chopping = false;
+    _cold->chopInverted = false;
+    _cold->chopSettle = 1;
+    _pendingFlags = 0;
+    _calibrating = false;
+    _cold->calMode = NAU7802_CALMOD_INTERNAL;
+    _cold->systemOffset[0] = _cold->systemOffset[1] = 0;
+    _cold->systemOffsetSet[0] = _cold->systemOffsetSet[1] = false;
+    _readCount = 0;
+    memset(_cold->tares, 0, sizeof(_cold->tares));
+    _cold->tares[0].used = true; // Slot 0 is "no tare"
+    _cold->activeTare = 0;
+    _activeTareOffset = 0;
+    _mux = nullptr;
+    _muxChannel = 0;
+    _iio = nullptr;
+    fd = -1;
+}
+
+//Constructor for a device behind an I2C mux channel
+NAU7802::NAU7802(uint8_t i2c_bus, NAU7802_Mux &mux, uint8_t muxChannel, uint8_t i2c_addr) : NAU7802(i2c_bus, i2c_addr)
+{
+    _mux = &mux;
+    _muxChannel = muxChannel;
+}
+
+//Constructor for a device the kernel nau7802 IIO driver owns
+//Readings, rate, gain and channel go through the driver; there is no register access.
+NAU7802::NAU7802(NAU7802_IIO &transport) : NAU7802(0)
+{
+    _iio = &transport;
 }
 
 //Sets up the NAU7802 for basic function
@@ -36,19 +111,35 @@ NAU7802::NAU7802(uint8_t i2c_bus, uint8_t i2c_addr)
 //Returns true upon completion
 bool NAU7802::begin(bool initialize)
 {
-    char device[32];
-    snprintf(device, sizeof(device), "/dev/i2c-%u", i2c_bus); // creating device address buffer
-    if ((fd = open(device, O_RDWR)) < 0)
+    if (_iio != nullptr)
     {
-        printf("File descriptor opening error %s\n", strerror(errno));
-        return 0;
+        // The driver reset, powered up and calibrated the chip when it probed
+        if (_iio->begin() == false)
+            return (false);
+        if (initialize)
+            return (setGain(NAU7802_GAIN_128) && setSampleRate(NAU7802_SPS_80));
+        return (true);
     }
-    else {
-        if (ioctl(fd, I2C_SLAVE, i2c_addr) < 0)
+
+    if (fd < 0)
+    {
+        // One descriptor per adapter, shared with every other NAU7802 on it
+        std::lock_guard<std::mutex> guard(adapterLock);
+        NAU7802_Adapter &adapter = adapters[i2c_bus];
+        if (adapter.users == 0)
         {
-            std::cout << "Open fd error" << errno << std::endl;
-            return 0;
+            char device[32];
+            snprintf(device, sizeof(device), "/dev/i2c-%u", i2c_bus); // creating device address buffer
+            if ((adapter.fd = open(device, O_RDWR)) < 0)
+            {
+                printf("File descriptor opening error %s\n", strerror(errno));
+                return 0;
+            }
+            adapter.address = 0; // No address set yet
+            adapter.mux = nullptr;
         }
+        adapter.users++;
+        fd = adapter.fd;
         printf("I2C connection established\n");
     }
 
@@ -89,48 +180,212 @@ bool NAU7802::begin(bool initialize)
 //Tests for device ack to I2C address
 bool NAU7802::isConnected()
 {
+   if (_iio != nullptr)
+        return (_iio->isConnected());
+
+   std::lock_guard<std::mutex> guard(adapters[i2c_bus].lock);
    if (ioctl(fd, I2C_SLAVE, i2c_addr) < 0) {
         printf("Error While Opening I2C connection : 3, Error Number: %d\n", errno);
+        adapters[i2c_bus].address = 0;
         return 0; // Sensor did not ACK
    }
+   adapters[i2c_bus].address = i2c_addr;
    return 1;  // All good
 }
 
 //Returns true if Cycle Ready bit is set (conversion is complete)
 bool NAU7802::available()
 {
+  if (_iio != nullptr)
+    return (_iio->available());
   return (getBit(NAU7802_PU_CTRL_CR, NAU7802_PU_CTRL));
 }
 
 //Calibrate analog front end of system. Returns true if CAL_ERR bit is 0 (no error)
 //Takes approximately 344ms to calibrate; wait up to 1000ms.
 //It is recommended that the AFE be re-calibrated any time the gain, SPS, or channel number is changed.
-bool NAU7802::calibrateAFE()
+bool NAU7802::calibrateAFE(uint8_t mode)
 {
-  beginCalibrateAFE();
+  beginCalibrateAFE(mode);
   return waitForCalibrateAFE(1000);
 }
 
 //Begin asynchronous calibration of the analog front end.
 // Poll for completion with calAFEStatus() or wait with waitForCalibrateAFE()
-void NAU7802::beginCalibrateAFE()
+// CALMOD and CALS go out in the same write, so a mode left over from an earlier system
+// calibration never leaks into a plain internal one.
+void NAU7802::beginCalibrateAFE(uint8_t mode)
 {
-  setBit(NAU7802_CTRL2_CALS, NAU7802_CTRL2);
+  uint8_t value = getRegister(NAU7802_CTRL2);
+  value &= ~(0b11 << NAU7802_CTRL2_CALMOD);
+  value |= (mode & 0b11) << NAU7802_CTRL2_CALMOD;
+  value |= 1 << NAU7802_CTRL2_CALS;
+  _cold->calMode = mode & 0b11;
+  _calibrating = setRegister(NAU7802_CTRL2, value);
+}
+
+//System offset calibration. Call with nothing on the scale, after an internal calibration.
+//The chip subtracts the empty scale reading itself, so the host zero offset becomes 0.
+//An internal calibration rewrites OCAL with the chip's own offset only, so the part the system
+//calibration added on top is remembered and put back after every later internal one.
+bool NAU7802::calibrateSystemOffset()
+{
+  int32_t internal = getOffsetCalibration();
+  if (_cold->systemOffsetSet[_channel])
+    internal -= _cold->systemOffset[_channel];
+
+  _cold->systemOffsetSet[_channel] = false;
+  if (calibrateAFE(NAU7802_CALMOD_OFFSET) == false)
+    return (false);
+  _cold->systemOffset[_channel] = getOffsetCalibration() - internal;
+  _cold->systemOffsetSet[_channel] = true;
+  _zeroOffset = 0;
+  return (true);
+}
+
+//Leave OCAL to internal calibrations again. The registers are not touched.
+void NAU7802::clearSystemCalibration()
+{
+  _cold->systemOffsetSet[0] = _cold->systemOffsetSet[1] = false;
+}
+
+//System gain calibration. Call with weightOnScale on the scale, after calibrateSystemOffset().
+//The chip scales whatever is on the scale to full scale (2^23 - 1 counts), so anything heavier
+//would clip. GCAL is then scaled down by weightOnScale / capacity so that capacity, the heaviest
+//load the scale has to read, lands at full scale instead. Calibrating at capacity is the most
+//accurate; a lighter weight works at the cost of the rounding in the rescale.
+//The cal factor follows from capacity, so getWeight() no longer depends on a host measured span.
+bool NAU7802::calibrateSystemGain(float weightOnScale, float capacity)
+{
+  if (weightOnScale <= 0 || capacity < weightOnScale)
+    return (false);
+  if (calibrateAFE(NAU7802_CALMOD_GAIN) == false)
+    return (false);
+
+  uint32_t gain = getGainCalibration();
+  if (gain == 0)
+    return (false); //Read failed
+  if (capacity > weightOnScale && setGainCalibration((uint32_t)llround((double)gain * weightOnScale / capacity)) == false)
+    return (false);
+
+  _zeroOffset = 0;
+  _calibrationFactor = 8388607.0 / capacity;
+  return (true);
+}
+
+//Each channel has its own OCAL/GCAL set; channel 2's sits 7 registers above channel 1's
+uint8_t NAU7802::calRegister(uint8_t channel1Register)
+{
+  if (_channel == NAU7802_CHANNEL_2)
+    return (channel1Register + (NAU7802_OCAL2_B2 - NAU7802_OCAL1_B2));
+  return (channel1Register);
+}
+
+//OCAL_B2..B0 of the selected channel, 24-bit two's complement
+int32_t NAU7802::getOffsetCalibration()
+{
+  uint8_t reg = calRegister(NAU7802_OCAL1_B2);
+  uint8_t data[3];
+  struct i2c_msg messages[2] = {
+      {i2c_addr, 0, 1, &reg},
+      {i2c_addr, I2C_M_RD, 3, data},
+  };
+  if (transfer(messages, 2) == false)
+    return (0);
+
+  uint32_t valueRaw = ((uint32_t)data[0] << 16) | ((uint32_t)data[1] << 8) | data[2];
+  return ((int32_t)(valueRaw << 8) >> 8); //Sign extend
+}
+
+//Restore a system offset calibration from NVM. One auto-increment write so the chip never sees half of it.
+bool NAU7802::setOffsetCalibration(int32_t offset)
+{
+  uint8_t data[4] = {calRegister(NAU7802_OCAL1_B2), (uint8_t)(offset >> 16), (uint8_t)(offset >> 8), (uint8_t)offset};
+  struct i2c_msg message = {i2c_addr, 0, 4, data};
+  return (transfer(&message, 1));
+}
+
+//GCAL_B3..B0 of the selected channel, unsigned 1.23 fixed point
+uint32_t NAU7802::getGainCalibration()
+{
+  uint8_t reg = calRegister(NAU7802_GCAL1_B3);
+  uint8_t data[4];
+  struct i2c_msg messages[2] = {
+      {i2c_addr, 0, 1, &reg},
+      {i2c_addr, I2C_M_RD, 4, data},
+  };
+  if (transfer(messages, 2) == false)
+    return (0);
+
+  return (((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3]);
+}
+
+bool NAU7802::setGainCalibration(uint32_t gain)
+{
+  uint8_t data[5] = {calRegister(NAU7802_GCAL1_B3), (uint8_t)(gain >> 24), (uint8_t)(gain >> 16), (uint8_t)(gain >> 8), (uint8_t)gain};
+  struct i2c_msg message = {i2c_addr, 0, 5, data};
+  return (transfer(&message, 1));
+}
+
+//Check that the chip applies the selected channel's OCAL/GCAL the way the host model expects:
+//  output = (raw - OCAL) * GCAL / 2^23
+//Averages the input once with neutral coefficients and once with the real ones, then compares.
+//Keep the load steady while this runs. The coefficients are always restored.
+bool NAU7802::verifyCalibration(NAU7802_Cal_Check &check, uint8_t averageAmount, float tolerance)
+{
+  if (averageAmount == 0)
+    return (false);
+
+  check.offset = getOffsetCalibration();
+  check.gain = getGainCalibration();
+
+  bool result = setOffsetCalibration(0) && setGainCalibration(NAU7802_GCAL_ONE);
+  getAverage(1); //The conversion straddling the change uses mixed coefficients
+  check.raw = getAverage(averageAmount);
+
+  result &= setOffsetCalibration(check.offset);
+  result &= setGainCalibration(check.gain);
+  getAverage(1);
+  check.measured = getAverage(averageAmount);
+
+  check.predicted = (check.raw - check.offset) * (check.gain / (float)NAU7802_GCAL_ONE);
+  check.error = check.measured - check.predicted;
+
+  //Both averages carry noise, the raw one scaled by the gain on its way into the prediction
+  if (tolerance <= 0)
+  {
+    float noise = NAU7802_noiseCounts(_gain, _sampleRate) / sqrt(averageAmount);
+    tolerance = 4 * noise * sqrt(1 + pow(check.gain / (float)NAU7802_GCAL_ONE, 2));
+  }
+  check.tolerance = tolerance;
+
+  return (result && fabs(check.error) <= tolerance);
 }
 
 //Check calibration status.
 NAU7802_Cal_Status NAU7802::calAFEStatus()
 {
+  if (_iio != nullptr)
+    return NAU7802_CAL_FAILURE; //The driver calibrates, the host can't
   if (getBit(NAU7802_CTRL2_CALS, NAU7802_CTRL2))
   {
     return NAU7802_CAL_IN_PROGRESS;
   }
+  bool finished = _calibrating; //First look since it completed
+  _calibrating = false;
 
   if (getBit(NAU7802_CTRL2_CAL_ERROR, NAU7802_CTRL2))
   {
     return NAU7802_CAL_FAILURE;
   }
 
+  //An internal calibration just replaced OCAL; put the system offset back on top
+  if (finished && _cold->calMode == NAU7802_CALMOD_INTERNAL && _cold->systemOffsetSet[_channel])
+  {
+    if (setOffsetCalibration(getOffsetCalibration() + _cold->systemOffset[_channel]) == false)
+      return NAU7802_CAL_FAILURE;
+  }
+
   // Calibration passed
   return NAU7802_CAL_SUCCESS;
 }
@@ -166,16 +421,47 @@ bool NAU7802::setSampleRate(uint8_t rate)
   if (rate > 0b111)
     rate = 0b111; //Error check
 
+  if (_iio != nullptr)
+  {
+    if (_iio->setSampleRate(rate) == false)
+      return (false);
+    _sampleRate = rate;
+    _pendingFlags |= NAU7802_FLAG_SETTLING;
+    return (true);
+  }
+
   uint8_t value = getRegister(NAU7802_CTRL2);
   value &= 0b10001111; //Clear CRS bits
   value |= rate << 4;  //Mask in new CRS bits
 
-  return (setRegister(NAU7802_CTRL2, value));
+  if (setRegister(NAU7802_CTRL2, value) == false)
+    return (false);
+  _sampleRate = rate;
+  _pendingFlags |= NAU7802_FLAG_SETTLING;
+  return (true);
+}
+
+//Last rate set with setSampleRate(). Cached so schedulers can ask without touching the bus.
+uint8_t NAU7802::getSampleRate()
+{
+  return (_sampleRate);
+}
+
+//Nominal time between conversions in microseconds at the current rate
+uint32_t NAU7802::getConversionPeriod()
+{
+  return (NAU7802_conversionPeriod(_sampleRate));
 }
 
 //Select between 1 and 2
 bool NAU7802::setChannel(uint8_t channelNumber)
 {
+  _channel = channelNumber == NAU7802_CHANNEL_1 ? NAU7802_CHANNEL_1 : NAU7802_CHANNEL_2;
+  _pendingFlags |= NAU7802_FLAG_SETTLING;
+
+  if (_iio != nullptr)
+    return (_iio->setChannel(_channel));
+
   if (channelNumber == NAU7802_CHANNEL_1)
     return (clearBit(NAU7802_CTRL2_CHS, NAU7802_CTRL2)); //Channel 1 (default)
   else
@@ -215,9 +501,162 @@ bool NAU7802::reset()
 {
   setBit(NAU7802_PU_CTRL_RR, NAU7802_PU_CTRL); //Set RR
   usleep(1E3);
+  _sampleRate = NAU7802_SPS_10; //Registers are back to power on defaults
+  _gain = NAU7802_GAIN_1;
+  _cold->powerProfile = NAU7802_PROFILE_LOW_NOISE;
+  _cold->chopInverted = false;
+  clearSystemCalibration(); //OCAL is back to 0
   return (clearBit(NAU7802_PU_CTRL_RR, NAU7802_PU_CTRL)); //Clear RR to leave reset state
 }
 
+//Register fields each profile programs
+//The PGA chopper cancels the PGA's offset and 1/f noise at the cost of its switching current, so
+//low power gives it up. The clock chopper (REG_CHPS) is not a profile choice: the power on
+//sequence turns it off and every profile leaves it off.
+typedef struct
+{
+  uint8_t pgaCurrent;   //PGA_CURR: 0 = 100%, 1 = 95%, 2 = 86%, 3 = 70%
+  uint8_t adcCurrent;   //ADC_CURR: 0 = 100%, 1 = 75%, 2 = 50%, 3 = 25%
+  uint8_t masterBias;   //MSTR_BIAS_CURR: 0 = 100% down to 7 = 54%
+  bool chopperOff;      //PGA CHP_DIS
+  bool ldoStable;       //PGA LDOMODE: 1 = improved stability, lower DC gain
+  bool bypassAtUnity;   //PGA BYPASS_EN while the gain is 1. setGain() keeps it in step
+} NAU7802_Profile_Fields;
+
+static const NAU7802_Profile_Fields profiles[] = {
+    {3, 2, 4, true, true, true},     //NAU7802_PROFILE_LOW_POWER
+    {2, 1, 1, false, true, false},   //NAU7802_PROFILE_BALANCED
+    {0, 0, 0, false, false, false},  //NAU7802_PROFILE_LOW_NOISE
+};
+
+//Program an operating profile
+//Reads ADC, PGA and PGA_PWR in one I2C_RDWR and writes them back in another, keeping the bits
+//the profile doesn't own (PGA_INV, RD_OTP_SEL, PGA_CAP_EN, ADC_VCM...).
+//Re-calibrate the AFE afterwards; offsets move with bias currents.
+bool NAU7802::setPowerProfile(uint8_t profile)
+{
+  if (profile > NAU7802_PROFILE_LOW_NOISE)
+    return (false);
+  const NAU7802_Profile_Fields &fields = profiles[profile];
+
+  uint8_t adcRegister = NAU7802_ADC;
+  uint8_t pgaRegister = NAU7802_PGA;
+  uint8_t adc;
+  uint8_t pga[2]; //PGA, PGA_PWR: consecutive, the chip auto-increments
+  struct i2c_msg reads[4] = {
+      {i2c_addr, 0, 1, &adcRegister},
+      {i2c_addr, I2C_M_RD, 1, &adc},
+      {i2c_addr, 0, 1, &pgaRegister},
+      {i2c_addr, I2C_M_RD, 2, pga},
+  };
+  if (transfer(reads, 4) == false)
+    return (false);
+
+  adc |= 0b11 << NAU7802_ADC_REG_CHPS; //Clock chopper off, whatever left it on
+
+  pga[0] &= ~((1 << NAU7802_PGA_CHP_DIS) | (1 << NAU7802_PGA_BYPASS_EN) | (1 << NAU7802_PGA_LDOMODE));
+  if (fields.chopperOff)
+    pga[0] |= 1 << NAU7802_PGA_CHP_DIS;
+  if (fields.ldoStable)
+    pga[0] |= 1 << NAU7802_PGA_LDOMODE;
+  if (fields.bypassAtUnity && _gain == NAU7802_GAIN_1)
+    pga[0] |= 1 << NAU7802_PGA_BYPASS_EN;
+
+  pga[1] &= 1 << NAU7802_PGA_PWR_PGA_CAP_EN;
+  pga[1] |= fields.pgaCurrent << NAU7802_PGA_PWR_PGA_CURR;
+  pga[1] |= fields.adcCurrent << NAU7802_PGA_PWR_ADC_CURR;
+  pga[1] |= fields.masterBias << NAU7802_PGA_PWR_MSTR_BIAS_CURR;
+
+  uint8_t adcWrite[2] = {NAU7802_ADC, adc};
+  uint8_t pgaWrite[3] = {NAU7802_PGA, pga[0], pga[1]};
+  struct i2c_msg writes[2] = {
+      {i2c_addr, 0, 2, adcWrite},
+      {i2c_addr, 0, 3, pgaWrite},
+  };
+  if (transfer(writes, 2) == false)
+    return (false);
+
+  _cold->powerProfile = profile;
+  return (true);
+}
+
+uint8_t NAU7802::getPowerProfile()
+{
+  return (_cold->powerProfile);
+}
+
+//Sample the current settings: mean, noise (standard deviation) and delivered conversion rate
+//Keep the input steady while this runs. Gives up if no conversion arrives for 1000ms.
+bool NAU7802::measureProfile(NAU7802_Profile_Report &report, uint16_t samples)
+{
+  report.profile = _cold->powerProfile;
+  report.samples = 0;
+  report.mean = 0;
+  report.noise = 0;
+  report.sampleRate = 0;
+  report.chopper = false;
+  if (samples < 2)
+    return (false);
+  report.chopper = (getBit(NAU7802_PGA_CHP_DIS, NAU7802_PGA) == false); //As the chip has it, not as the profile asked
+
+  //Let the first conversion after any change go, it may straddle it
+  uint64_t last = NAU7802_timestamp();
+  bool discarded = false;
+  uint64_t first = 0;
+  double mean = 0;
+  double m2 = 0;
+  while (report.samples < samples)
+  {
+    if (available() == false)
+    {
+      if (NAU7802_timestamp() - last > 1000000)
+        return (false); //Timeout
+      usleep(500);
+      continue;
+    }
+
+    int32_t reading = getReading();
+    last = NAU7802_timestamp();
+    if (discarded == false)
+    {
+      discarded = true;
+      first = last;
+      continue;
+    }
+
+    report.samples++;
+    double delta = reading - mean;
+    mean += delta / report.samples;
+    m2 += delta * (reading - mean);
+  }
+
+  report.mean = mean;
+  report.noise = sqrt(m2 / (report.samples - 1));
+  if (last > first)
+    report.sampleRate = report.samples * 1E6 / (last - first);
+  return (true);
+}
+
+//Measure two profiles back to back on the same input, calibrating the AFE after each switch
+//The profile in use before the call is restored (and recalibrated) afterwards.
+bool NAU7802::compareProfiles(uint8_t profileA, uint8_t profileB, NAU7802_Profile_Report reports[2], uint16_t samples)
+{
+  uint8_t original = _cold->powerProfile;
+  uint8_t profile[2] = {profileA, profileB};
+  bool result = true;
+
+  for (uint8_t x = 0; x < 2; x++)
+  {
+    result &= setPowerProfile(profile[x]);
+    result &= calibrateAFE();
+    result &= measureProfile(reports[x], samples);
+  }
+
+  result &= setPowerProfile(original);
+  result &= calibrateAFE();
+  return (result);
+}
+
 //Set the onboard Low-Drop-Out voltage regulator to a given value
 //2.4, 2.7, 3.0, 3.3, 3.6, 3.9, 4.2, 4.5V are available
 bool NAU7802::setLDO(uint8_t ldoValue)
@@ -241,11 +680,38 @@ bool NAU7802::setGain(uint8_t gainValue)
   if (gainValue > 0b111)
     gainValue = 0b111; //Error check
 
+  if (_iio != nullptr)
+  {
+    if (_iio->setGain(gainValue) == false)
+      return (false);
+    _gain = gainValue;
+    _pendingFlags |= NAU7802_FLAG_SETTLING;
+    return (true);
+  }
+
   uint8_t value = getRegister(NAU7802_CTRL1);
   value &= 0b11111000; //Clear gain bits
   value |= gainValue;  //Mask in new bits
 
-  return (setRegister(NAU7802_CTRL1, value));
+  if (setRegister(NAU7802_CTRL1, value) == false)
+    return (false);
+  _gain = gainValue;
+  _pendingFlags |= NAU7802_FLAG_SETTLING;
+
+  //Profiles that bypass the PGA only do so at unity gain, so follow the gain in and out of x1
+  if (profiles[_cold->powerProfile].bypassAtUnity)
+  {
+    if (gainValue == NAU7802_GAIN_1)
+      return (setBit(NAU7802_PGA_BYPASS_EN, NAU7802_PGA));
+    return (clearBit(NAU7802_PGA_BYPASS_EN, NAU7802_PGA));
+  }
+  return (true);
+}
+
+//Last gain set with setGain(). Cached so filters can look up noise figures without touching the bus.
+uint8_t NAU7802::getGain()
+{
+  return (_gain);
 }
 
 //Get the revision code of this IC
@@ -259,10 +725,39 @@ uint8_t NAU7802::getRevisionCode()
 //Assumes CR Cycle Ready bit (ADC conversion complete) has been checked to be 1
 int32_t NAU7802::getReading()
 {
+    int32_t value;
+    if (readConversion(value) == false)
+        return (0); // Error
+
+    publish(value);
+    return (value);
+}
+
+//Read ADCO_B2..B0 without publishing it
+//A failed read is repeated once and flagged; the conversion stays valid until the next one lands.
+bool NAU7802::readConversion(int32_t &value)
+{
+    if (_iio != nullptr)
+    {
+        if (_iio->readConversion(value) == false)
+            return (false);
+        _pendingFlags |= NAU7802_saturation(value);
+        return (true);
+    }
+
     uint8_t data[3];
-    uint8_t ret;
+    int32_t ret;
+    std::unique_lock<std::mutex> guard(adapters[i2c_bus].lock);
+    if (route() == false)
+        return (false);
     // read Current from register
     ret = i2c_smbus_read_i2c_block_data(fd, NAU7802_ADCO_B2, sizeof(data), data);
+    if (ret < (int32_t)sizeof(data))
+    {
+        _pendingFlags |= NAU7802_FLAG_RETRIED;
+        ret = i2c_smbus_read_i2c_block_data(fd, NAU7802_ADCO_B2, sizeof(data), data);
+    }
+    guard.unlock();
     // data[0] contains the length of the data
     if (ret > 1) // number of bytes that were read
     {
@@ -276,21 +771,358 @@ int32_t NAU7802::getReading()
         // the sign of the original value
         int32_t valueShifted = (int32_t)(valueRaw << 8);
         // shift the number back right to recover its intended magnitude
-        int32_t value = (valueShifted >> 8);
+        value = (valueShifted >> 8);
+        _pendingFlags |= NAU7802_saturation(value);
+        return (true);
+    }
+
+    return (false);
+}
+
+// Make a reading available to other threads through getLatest()
+void NAU7802::publish(int32_t value)
+{
+    NAU7802_Sample sample;
+    sample.timestamp_us = NAU7802_timestamp();
+    sample.value = value;
+    sample.device = _deviceTag;
+    sample.channel = _channel;
+    sample.flags = takeFlags();
+    sample.sequence = ++_readCount;
+    _latest.publish(sample);
+}
+
+//Flags for the reading about to be published. Clears the one-shot ones.
+uint8_t NAU7802::takeFlags()
+{
+    uint8_t flags = _pendingFlags;
+    if (_calibrating)
+        flags |= NAU7802_FLAG_CALIBRATING;
+    _pendingFlags = 0;
+    return (flags);
+}
+
+//Wait up to timeout_ms for a conversion and read it without publishing
+bool NAU7802::waitConversion(int32_t &value, uint32_t timeout_ms)
+{
+  unsigned long startTime = millis();
+  while (available() == false)
+  {
+    if (millis() - startTime > timeout_ms)
+      return (false);
+    usleep(1E3);
+  }
+  return (readConversion(value));
+}
+
+//Alternate the PGA input polarity between the two readings of a pair and combine them
+//Front end offset and slow drift add the same amount to both polarities and cancel in
+//(non-inverted - inverted) / 2. The first settleDiscards conversions after each flip
+//are thrown away, so a reading costs 2 + 2 * settleDiscards conversions.
+//The front end offset no longer shows up in readings, so re-zero after switching modes.
+bool NAU7802::setPolarityChopping(bool enable, uint8_t settleDiscards)
+{
+  _cold->chopSettle = settleDiscards;
+  _cold->chopping = enable;
+  if (_cold->chopInverted == false)
+    return (true);
+
+  //Leave the input the normal way round
+  return (setInverted(false));
+}
+
+bool NAU7802::getPolarityChopping()
+{
+  return (_cold->chopping);
+}
+
+//One offset free reading from a pair of opposite polarity conversions
+//The input is back the normal way round, and settled, when this returns, so plain readings
+//taken in between never see it inverted. Blocks for up to 1000ms per conversion; returns 0 on timeout.
+int32_t NAU7802::getChoppedReading()
+{
+  int32_t value;
+  if (chopped(value) == false)
+    return (0);
+  return (value);
+}
+
+//getChoppedReading() that tells a timeout apart from a reading of 0
+bool NAU7802::chopped(int32_t &value)
+{
+  //A restore that failed last time goes first
+  if (_cold->chopInverted && restoreInput() == false)
+    return (false);
+
+  int32_t normal, inverted;
+  if (waitConversion(normal, 1000) == false)
+    return (false);
+  if (setInverted(true) == false)
+    return (false);
+  if (discardSettling() == false || waitConversion(inverted, 1000) == false)
+  {
+    restoreInput();
+    return (false);
+  }
+
+  value = (normal - inverted) / 2;
+  publish(value);
+  restoreInput(); //Retried by the next pair if it fails; this reading is good either way
+  return (true);
+}
 
-        return (value);
+//Drive PGA INV. chopInverted only follows once the write went through
+bool NAU7802::setInverted(bool inverted)
+{
+  bool written = inverted ? setBit(NAU7802_PGA_INV, NAU7802_PGA) : clearBit(NAU7802_PGA_INV, NAU7802_PGA);
+  if (written)
+    _cold->chopInverted = inverted;
+  return (written);
+}
+
+//Conversions straddling a polarity flip mix both polarities
+bool NAU7802::discardSettling()
+{
+  int32_t discard;
+  for (uint8_t x = 0; x < _cold->chopSettle; x++)
+  {
+    if (waitConversion(discard, 1000) == false)
+      return (false);
+  }
+  return (true);
+}
+
+//Put the input back the normal way round and wait until conversions are clean again
+bool NAU7802::restoreInput()
+{
+  return (setInverted(false) && discardSettling());
+}
+
+//Read status and conversion of several devices on the same adapter with as few syscalls as possible
+//Each device takes four messages in one I2C_RDWR: PU_CTRL address, PU_CTRL, ADCO_B2 address, ADCO_B2..B0.
+//The kernel takes up to I2C_RDWR_IOCTL_MAX_MSGS messages per call, so ten devices share one ioctl.
+//Devices behind a mux are read grouped by channel, with a channel select message inserted only
+//where the enabled channel changes, and a deselect of the previous mux wherever the mux changes.
+//Devices whose CR bit was clear are marked invalid; their data bytes were a stale conversion.
+//Every device must be on the same adapter. Returns the number of valid readings in the frame,
+//or 0 with nothing read if the devices span adapters.
+uint8_t NAU7802::readAll(NAU7802 *devices[], uint8_t count, NAU7802_Frame &frame)
+{
+  const uint8_t perCall = I2C_RDWR_IOCTL_MAX_MSGS / 4;
+
+  if (count > NAU7802_FRAME_DEVICES)
+    count = NAU7802_FRAME_DEVICES;
+  frame.count = count;
+  frame.validCount = 0;
+  frame.ioctls = 0;
+  for (uint8_t x = 0; x < count; x++)
+    frame.valid[x] = false; //Cleared before any check can bail out
+  if (count == 0)
+    return (0);
+
+  //Batching works on i2c-dev messages of one adapter; devices behind the IIO driver are read
+  //with readBuffered(), and each adapter needs its own frame
+  for (uint8_t x = 0; x < count; x++)
+  {
+    if (devices[x]->_iio != nullptr || devices[x]->i2c_bus != devices[0]->i2c_bus)
+      return (0);
+  }
+
+  //Read order: direct devices first, then by mux and channel
+  uint8_t order[NAU7802_FRAME_DEVICES];
+  for (uint8_t x = 0; x < count; x++)
+    order[x] = x;
+  std::stable_sort(order, order + count, [devices](uint8_t a, uint8_t b) {
+    if (devices[a]->_mux != devices[b]->_mux)
+      return std::less<NAU7802_Mux *>()(devices[a]->_mux, devices[b]->_mux);
+    return devices[a]->_muxChannel < devices[b]->_muxChannel;
+  });
+
+  static const uint8_t statusRegister = NAU7802_PU_CTRL;
+  static const uint8_t dataRegister = NAU7802_ADCO_B2;
+  struct i2c_msg messages[I2C_RDWR_IOCTL_MAX_MSGS];
+  uint8_t replies[perCall][4];      //Status followed by the 24-bit reading
+  NAU7802_Mux *changedMux[2 * perCall]; //Mux messages queued in this call, in bus order...
+  uint8_t changedChannel[2 * perCall];  //...and the channel each enables, NAU7802_MUX_NONE to disable
+  NAU7802_Adapter &adapter = adapters[devices[0]->i2c_bus];
+  std::lock_guard<std::mutex> guard(adapter.lock); //Mux state is planned across the whole frame
+
+  uint8_t next = 0;
+  while (next < count)
+  {
+    uint8_t batch = 0;
+    uint8_t messageCount = 0;
+    uint8_t changeCount = 0;
+    NAU7802_Mux *startMux = adapter.mux; //Mux with a channel enabled when the call starts
+    NAU7802_Mux *activeMux = startMux;   //...and after the messages queued so far
+
+    while (next + batch < count && batch < perCall)
+    {
+      NAU7802 *device = devices[order[next + batch]];
+      bool deselect = (activeMux != nullptr && activeMux != device->_mux);
+      bool select = false;
+      if (device->_mux != nullptr)
+      {
+        //The cache only catches up after the transfer, so messages already queued come first
+        uint8_t enabled = device->_mux->getChannel();
+        for (uint8_t x = changeCount; x-- > 0;)
+        {
+          if (changedMux[x] == device->_mux)
+          {
+            enabled = changedChannel[x];
+            break;
+          }
+        }
+        select = (deselect || enabled != device->_muxChannel);
+      }
+      if (messageCount + 4 + deselect + select > I2C_RDWR_IOCTL_MAX_MSGS)
+        break;
+
+      if (deselect)
+      {
+        messages[messageCount++] = activeMux->deselectMessage();
+        changedMux[changeCount] = activeMux;
+        changedChannel[changeCount++] = NAU7802_MUX_NONE;
+        activeMux = nullptr;
+      }
+      if (select)
+      {
+        messages[messageCount++] = device->_mux->selectMessage(device->_muxChannel);
+        changedMux[changeCount] = device->_mux;
+        changedChannel[changeCount++] = device->_muxChannel;
+      }
+      if (device->_mux != nullptr)
+        activeMux = device->_mux;
+
+      uint16_t address = device->i2c_addr;
+      messages[messageCount++] = {address, 0, 1, (uint8_t *)&statusRegister};
+      messages[messageCount++] = {address, I2C_M_RD, 1, &replies[batch][0]};
+      messages[messageCount++] = {address, 0, 1, (uint8_t *)&dataRegister};
+      messages[messageCount++] = {address, I2C_M_RD, 3, &replies[batch][1]};
+      batch++;
+    }
+
+    //I2C_RDWR carries its own addresses, so any descriptor open on the adapter will do
+    struct i2c_rdwr_ioctl_data transfer = {messages, messageCount};
+    bool ok = (ioctl(devices[order[next]]->fd, I2C_RDWR, &transfer) >= 0);
+    frame.ioctls++;
+    if (ok == false)
+      printf("Error While reading Nau7802 frame, Error: %d\n", errno);
+
+    if (ok)
+    {
+      for (uint8_t x = 0; x < changeCount; x++)
+      {
+        if (changedChannel[x] == NAU7802_MUX_NONE)
+          changedMux[x]->deselected();
+        else
+          changedMux[x]->selected(changedChannel[x]);
+      }
+      adapter.mux = activeMux;
+    }
+    else
+    {
+      //Unknown how far the transfer got, so any mux it touched may have a channel enabled.
+      //Disable them all; one that won't answer stays recorded for route() to retry.
+      adapter.mux = nullptr;
+      if (startMux != nullptr && startMux->deselect() == false)
+        adapter.mux = startMux;
+      for (uint8_t x = 0; x < changeCount; x++)
+      {
+        if (changedMux[x] == startMux || (x > 0 && changedMux[x] == changedMux[x - 1]))
+          continue; //Already disabled
+        if (changedMux[x]->deselect() == false)
+          adapter.mux = changedMux[x];
+      }
+    }
+
+    uint64_t now = NAU7802_timestamp();
+    for (uint8_t x = 0; x < batch; x++)
+    {
+      uint8_t index = order[next + x];
+      NAU7802 *device = devices[index];
+      NAU7802_Sample &sample = frame.samples[index];
+      sample.timestamp_us = now;
+      sample.device = device->_deviceTag;
+      sample.channel = device->_channel;
+      sample.flags = 0;
+
+      frame.valid[index] = ok && (replies[x][0] & (1 << NAU7802_PU_CTRL_CR));
+      if (frame.valid[index] == false)
+      {
+        sample.value = 0;
+        sample.sequence = device->_readCount;
+        continue;
+      }
+
+      uint32_t valueRaw = (uint32_t)replies[x][1] << 16;
+      valueRaw |= (uint32_t)replies[x][2] << 8;
+      valueRaw |= (uint32_t)replies[x][3];
+      sample.value = (int32_t)(valueRaw << 8) >> 8; //Sign extend the 24-bit value
+      sample.flags = device->takeFlags() | NAU7802_saturation(sample.value);
+      sample.sequence = ++device->_readCount;
+      device->_latest.publish(sample);
+      frame.validCount++;
     }
+    next += batch;
+  }
+
+  return (frame.validCount);
+}
+
+//Everything the IIO driver has buffered since the last call, up to maxSamples, in one read()
+//Stamped like getReading() samples and the newest one published. Returns 0 on the i2c-dev transport.
+size_t NAU7802::readBuffered(NAU7802_Sample *out, size_t maxSamples)
+{
+  if (_iio == nullptr)
+    return (0);
 
-    return (0); // Error
+  size_t count = _iio->readSamples(out, maxSamples);
+  for (size_t x = 0; x < count; x++)
+  {
+    out[x].device = _deviceTag;
+    out[x].channel = _channel;
+    out[x].flags = takeFlags() | NAU7802_saturation(out[x].value);
+    out[x].sequence = ++_readCount;
+  }
+  if (count > 0)
+    _latest.publish(out[count - 1]);
+  return (count);
 }
 
 //Return the average of a given number of readings
 //Gives up after 1000ms so don't call this function to average 8 samples setup at 1Hz output (requires 8s)
 int32_t NAU7802::getAverage(uint8_t averageAmount)
+{
+  int32_t value;
+  if (average(averageAmount, value) == false)
+    return (0); //Timeout - Bail with error
+  return (value);
+}
+
+//getAverage() that tells a timeout apart from a reading of 0
+bool NAU7802::average(uint8_t averageAmount, int32_t &value)
 {
   long total = 0;
   uint8_t samplesAquired = 0;
 
+  if (averageAmount == 0)
+    return (false);
+
+  if (_cold->chopping)
+  {
+    //Each chopped reading already waits for its own conversions
+    for (; samplesAquired < averageAmount; samplesAquired++)
+    {
+      int32_t reading;
+      if (chopped(reading) == false)
+        return (false); //Timeout
+      total += reading;
+    }
+    value = total / averageAmount;
+    return (true);
+  }
+
   unsigned long startTime = millis();
   while (1)
   {
@@ -301,13 +1133,12 @@ int32_t NAU7802::getAverage(uint8_t averageAmount)
         break; //All done
     }
     if (millis() - startTime > 1000) {
-      return (0); //Timeout - Bail with error
+      return (false); //Timeout
     }
       usleep(1E3);
   }
-  total /= averageAmount;
-
-  return (total);
+  value = total / averageAmount;
+  return (true);
 }
 
 //Call when scale is setup, level, at running temperature, with nothing on it
@@ -348,9 +1179,12 @@ float NAU7802::getCalibrationFactor()
 }
 
 //Returns the y of y = mx + b using the current weight on scale, the cal factor, and the offset.
+//Returns 0, and leaves getLatestWeight() alone, if no conversion arrived in time.
 float NAU7802::getWeight(bool allowNegativeWeights, uint8_t samplesToTake)
 {
-  int32_t onScale = getAverage(samplesToTake);
+  int32_t onScale;
+  if (average(samplesToTake, onScale) == false)
+    return (0);
 
   //Prevent the current reading from being less than zero offset
   //This happens when the scale is zero'd, unloaded, and the load cell reports a value slightly less than zero value
@@ -362,9 +1196,206 @@ float NAU7802::getWeight(bool allowNegativeWeights, uint8_t samplesToTake)
   }
 
   float weight = (onScale - _zeroOffset) / _calibrationFactor;
+  _latest.publishWeight(weight);
+  return (weight);
+}
+
+//Store a container tare, in counts above the zero offset, into a slot
+//Slot 0 is reserved for "no tare". Returns false for a bad slot.
+bool NAU7802::setTare(uint8_t slot, int32_t offset, const char *name)
+{
+  if (slot == 0 || slot >= NAU7802_TARE_SLOTS)
+    return (false);
+
+  NAU7802_Tare &tare = _cold->tares[slot];
+  tare.offset = offset;
+  tare.preset = false;
+  tare.used = true;
+  memset(tare.name, 0, sizeof(tare.name));
+  if (name != nullptr)
+    strncpy(tare.name, name, sizeof(tare.name) - 1);
+
+  if (slot == _cold->activeTare)
+    _activeTareOffset.store(offset, std::memory_order_relaxed);
+  return (true);
+}
+
+//Store a container tare from its known weight, e.g. a printed container weight
+//The calibration factor must already be set
+bool NAU7802::setPresetTare(uint8_t slot, float weight, const char *name)
+{
+  if (setTare(slot, (int32_t)lrintf(weight * _calibrationFactor), name) == false)
+    return (false);
+  _cold->tares[slot].preset = true;
+  return (true);
+}
+
+//Call with the empty container on the scale. Measures once so later switches are free.
+//Returns false, leaving the slot alone, if no conversion arrived in time.
+bool NAU7802::calculateTare(uint8_t slot, const char *name, uint8_t averageAmount)
+{
+  if (slot == 0 || slot >= NAU7802_TARE_SLOTS)
+    return (false);
+
+  int32_t onScale;
+  if (average(averageAmount, onScale) == false)
+    return (false);
+  return (setTare(slot, onScale - _zeroOffset, name));
+}
+
+bool NAU7802::clearTare(uint8_t slot)
+{
+  if (slot == 0 || slot >= NAU7802_TARE_SLOTS)
+    return (false);
+
+  memset(&_cold->tares[slot], 0, sizeof(NAU7802_Tare));
+  if (slot == _cold->activeTare)
+    selectTare(0);
+  return (true);
+}
+
+//Switch the active container. Constant time and never touches the bus, so it can change between samples.
+//Returns false if the slot holds no tare.
+bool NAU7802::selectTare(uint8_t slot)
+{
+  if (slot >= NAU7802_TARE_SLOTS || _cold->tares[slot].used == false)
+    return (false);
+
+  _cold->activeTare = slot;
+  _activeTareOffset.store(_cold->tares[slot].offset, std::memory_order_relaxed);
+  return (true);
+}
+
+uint8_t NAU7802::getActiveTare()
+{
+  return (_cold->activeTare);
+}
+
+//Look up a tare slot by name. Returns -1 if there is none.
+int NAU7802::findTare(const char *name)
+{
+  if (name == nullptr || name[0] == 0)
+    return (-1);
+
+  for (uint8_t x = 1; x < NAU7802_TARE_SLOTS; x++)
+  {
+    if (_cold->tares[x].used && strncmp(_cold->tares[x].name, name, NAU7802_TARE_NAME_LENGTH) == 0)
+      return (x);
+  }
+  return (-1);
+}
+
+bool NAU7802::getTare(uint8_t slot, NAU7802_Tare &tare)
+{
+  if (slot >= NAU7802_TARE_SLOTS || _cold->tares[slot].used == false)
+    return (false);
+  tare = _cold->tares[slot];
+  return (true);
+}
+
+//Weight including the container
+float NAU7802::getGrossWeight(bool allowNegativeWeights, uint8_t samplesToTake)
+{
+  return (getWeight(allowNegativeWeights, samplesToTake));
+}
+
+//Weight of the contents: gross weight minus the active container
+float NAU7802::getNetWeight(bool allowNegativeWeights, uint8_t samplesToTake)
+{
+  int32_t onScale;
+  if (average(samplesToTake, onScale) == false)
+    return (0); //Timeout, nothing published
+  onScale -= _activeTareOffset.load(std::memory_order_relaxed);
+
+  //Same clamp as getWeight(), relative to the container
+  if (allowNegativeWeights == false)
+  {
+    if (onScale < _zeroOffset)
+      onScale = _zeroOffset;
+  }
+
+  float weight = (onScale - _zeroOffset) / _calibrationFactor;
+  _latest.publishWeight(weight);
   return (weight);
 }
 
+//Convert a reading that was already taken. No averaging, no I2C.
+float NAU7802::toGrossWeight(int32_t reading)
+{
+  return ((reading - _zeroOffset) / _calibrationFactor);
+}
+
+float NAU7802::toNetWeight(int32_t reading)
+{
+  return ((reading - _zeroOffset - _activeTareOffset.load(std::memory_order_relaxed)) / _calibrationFactor);
+}
+
+//Copy out zero offset, cal factor and tares, e.g. for storing into NVM
+void NAU7802::getCalibration(NAU7802_Calibration &calibration)
+{
+  calibration.zeroOffset = _zeroOffset;
+  calibration.calibrationFactor = _calibrationFactor;
+  calibration.activeTare = _cold->activeTare;
+  memcpy(calibration.tares, _cold->tares, sizeof(_cold->tares));
+}
+
+//Restore everything saved with getCalibration()
+void NAU7802::setCalibration(const NAU7802_Calibration &calibration)
+{
+  _zeroOffset = calibration.zeroOffset;
+  _calibrationFactor = calibration.calibrationFactor;
+  memcpy(_cold->tares, calibration.tares, sizeof(_cold->tares));
+  _cold->tares[0].used = true;
+  _cold->tares[0].offset = 0;
+  if (selectTare(calibration.activeTare) == false)
+    selectTare(0);
+}
+
+//Copy of the last reading taken by getReading(), from whichever thread drives the device
+//Readers never block the writer and never touch the bus. Returns false if nothing has been read yet.
+bool NAU7802::getLatest(NAU7802_Sample &sample) const
+{
+  return (_latest.read(sample));
+}
+
+//Last weight computed by getWeight()
+float NAU7802::getLatestWeight() const
+{
+  return (_latest.readWeight());
+}
+
+//Tag stamped into every sample from this device. Useful when merging many devices.
+void NAU7802::setDeviceTag(uint16_t tag)
+{
+  _deviceTag = tag;
+}
+
+uint16_t NAU7802::getDeviceTag()
+{
+  return (_deviceTag);
+}
+
+//I2C adapter number, the N in /dev/i2c-N
+uint8_t NAU7802::getBus()
+{
+  return (i2c_bus);
+}
+
+uint8_t NAU7802::getAddress()
+{
+  return (i2c_addr);
+}
+
+NAU7802_Mux *NAU7802::getMux()
+{
+  return (_mux);
+}
+
+uint8_t NAU7802::getMuxChannel()
+{
+  return (_muxChannel);
+}
+
 //Set Int pin to be high when data is ready (default)
 bool NAU7802::setIntPolarityHigh()
 {
@@ -405,7 +1436,12 @@ bool NAU7802::getBit(uint8_t bitNumber, uint8_t registerAddress)
 uint8_t NAU7802::getRegister(uint8_t registerAddress)
 {
     int32_t retVal;
-    retVal = i2c_smbus_read_byte_data(fd, registerAddress);
+    {
+        std::lock_guard<std::mutex> guard(adapters[i2c_bus].lock);
+        if (route() == false)
+            return 0;
+        retVal = i2c_smbus_read_byte_data(fd, registerAddress);
+    }
     if (retVal < 0) {
         printf("Error While reading Nau7802 I2C register, Error: %d\n", errno);
         return 0;
@@ -420,7 +1456,12 @@ uint8_t NAU7802::getRegister(uint8_t registerAddress)
 bool NAU7802::setRegister(uint8_t registerAddress, uint8_t value)
 {
     int32_t retVal;
-    retVal = i2c_smbus_write_byte_data(fd, registerAddress, value);
+    {
+        std::lock_guard<std::mutex> guard(adapters[i2c_bus].lock);
+        if (route() == false)
+            return 0;
+        retVal = i2c_smbus_write_byte_data(fd, registerAddress, value);
+    }
     if (retVal < 0) {
         printf("Error While setting Nau7802 I2C register, Error#: %d\n", errno);
         return 0;
@@ -429,6 +1470,53 @@ bool NAU7802::setRegister(uint8_t registerAddress, uint8_t value)
     return 1;
 }
 
+//Run several messages in one I2C_RDWR after routing the bus to this device
+bool NAU7802::transfer(struct i2c_msg *messages, uint32_t count)
+{
+    std::lock_guard<std::mutex> guard(adapters[i2c_bus].lock);
+    if (route() == false)
+        return false;
+
+    struct i2c_rdwr_ioctl_data data = {messages, count};
+    if (ioctl(fd, I2C_RDWR, &data) < 0) {
+        printf("Error While transferring Nau7802 I2C messages, Error#: %d\n", errno);
+        return false;
+    }
+    return true;
+}
+
+//Point the shared adapter at this device and enable its mux channel. Call with the adapter locked
+//A channel left enabled on another mux is disabled first, so only this device answers.
+//All of it is cached, so this costs no syscall when the last transaction was to the same device
+bool NAU7802::route()
+{
+    if (_iio != nullptr)
+        return false; //No register access through the driver
+
+    NAU7802_Adapter &adapter = adapters[i2c_bus];
+    if (adapter.mux != nullptr && adapter.mux != _mux)
+    {
+        if (adapter.mux->deselect() == false)
+            return false;
+        adapter.mux = nullptr;
+    }
+
+    if (adapter.address != i2c_addr)
+    {
+        if (ioctl(fd, I2C_SLAVE, i2c_addr) < 0) {
+            printf("Error While Opening I2C connection : 3, Error Number: %d\n", errno);
+            adapter.address = 0;
+            return false;
+        }
+        adapter.address = i2c_addr;
+    }
+
+    if (_mux == nullptr)
+        return true;
+    adapter.mux = _mux; //Even a failed select may have changed the channel
+    return _mux->select(_muxChannel);
+}
+
 unsigned long NAU7802::millis() {
     unsigned long value_ms =
         std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - refTime).count();
@@ -442,5 +1530,16 @@ unsigned long NAU7802::micros() {
 }
 
 NAU7802::~NAU7802(){
-    close(fd);
+    delete _cold;
+    if (fd < 0)
+        return;
+
+    // Close the adapter with its last user
+    std::lock_guard<std::mutex> guard(adapterLock);
+    NAU7802_Adapter &adapter = adapters[i2c_bus];
+    if (--adapter.users == 0)
+    {
+        close(adapter.fd);
+        adapter.fd = -1;
+    }
 }
@@ -39,9 +39,16 @@ extern "C" {
 #include <cstdlib>
 #include <errno.h>
 #include <chrono>
+#include <atomic>
+
+#include "NAU7802_Sample.h"
+#include "NAU7802_Latest.h"
+#include "NAU7802_Mux.h"
 
 using namespace std;
 
+class NAU7802_IIO;
+
 //Register Map
 typedef enum
 {
@@ -126,6 +133,33 @@ typedef enum
   NAU7802_PGA_PWR_PGA_CAP_EN = 7,
 } PGA_PWR_Bits;
 
+//Bits within the ADC register (0x15, shared with OTP)
+typedef enum
+{
+  NAU7802_ADC_REG_CHP = 0,
+  NAU7802_ADC_ADC_VCM = 2,
+  NAU7802_ADC_REG_CHPS = 4, //2 bits, 0b11 turns the clock chopper off
+} ADC_Bits;
+
+//Operating profiles trading supply current against noise
+typedef enum
+{
+  NAU7802_PROFILE_LOW_POWER = 0, //Reduced PGA/ADC/bias currents, PGA chopper off, PGA bypassed at gain 1
+  NAU7802_PROFILE_BALANCED,      //Moderate current reductions
+  NAU7802_PROFILE_LOW_NOISE,     //Full currents, high accuracy LDO mode. Power on default
+} NAU7802_Power_Profile;
+
+//Result of measureProfile()
+typedef struct
+{
+  uint8_t profile;    //NAU7802_Power_Profile measured
+  uint16_t samples;   //Conversions used
+  float mean;         //Counts
+  float noise;        //Standard deviation, counts
+  float sampleRate;   //Conversions per second actually delivered
+  bool chopper;       //PGA chopper was running. Without it the mean carries the PGA offset
+} NAU7802_Profile_Report;
+
 //Allowed Low drop out regulator voltages
 typedef enum
 {
@@ -169,6 +203,35 @@ typedef enum
   NAU7802_CHANNEL_2 = 1,
 } NAU7802_Channels;
 
+//Nominal conversion period in microseconds for a CRS value
+inline uint32_t NAU7802_conversionPeriod(uint8_t rate)
+{
+  switch (rate)
+  {
+  case NAU7802_SPS_320:
+    return 3125;
+  case NAU7802_SPS_80:
+    return 12500;
+  case NAU7802_SPS_40:
+    return 25000;
+  case NAU7802_SPS_20:
+    return 50000;
+  default:
+    return 100000;
+  }
+}
+
+//Typical RMS noise of a raw reading in counts for a gain and CRS value
+//Approximate figures for a bridge input: input referred noise dominates at
+//high gain and wideband noise grows with the output data rate. Measure the
+//real figure on site when it matters.
+inline float NAU7802_noiseCounts(uint8_t gain, uint8_t rate)
+{
+  static const float atTenSPS[8] = {2.0, 2.0, 2.5, 3.0, 5.0, 9.0, 17.0, 34.0}; //Indexed by NAU7802_GAIN value
+  static const float rateFactor[8] = {1.0, 1.41, 2.0, 2.83, 2.83, 2.83, 2.83, 5.66}; //sqrt(SPS / 10), indexed by CRS value
+  return atTenSPS[gain & 0b111] * rateFactor[rate & 0b111];
+}
+
 //Calibration state
 typedef enum
 {
@@ -177,17 +240,78 @@ typedef enum
   NAU7802_CAL_FAILURE = 2,
 } NAU7802_Cal_Status;
 
+//Calibration modes, CTRL2 CALMOD
+typedef enum
+{
+  NAU7802_CALMOD_INTERNAL = 0b00, //Internal offset, inputs shorted inside the chip
+  NAU7802_CALMOD_OFFSET = 0b10,   //System offset, nothing on the scale. Result lands in the selected channel's OCAL
+  NAU7802_CALMOD_GAIN = 0b11,     //System gain, known weight on the scale. Result lands in the selected channel's GCAL
+} NAU7802_Cal_Mode;
+
+#define NAU7802_GCAL_ONE 0x00800000 //GCAL for unity gain, 1.23 fixed point
+
+//Result of verifyCalibration()
+typedef struct
+{
+  int32_t offset;   //OCAL in use on the selected channel
+  uint32_t gain;    //GCAL in use on the selected channel
+  float raw;        //Average with OCAL = 0 and GCAL = 1
+  float measured;   //Average with the calibration applied by the chip
+  float predicted;  //(raw - offset) * gain / 2^23
+  float error;      //measured - predicted, counts
+  float tolerance;  //Largest |error| accepted, counts
+} NAU7802_Cal_Check;
+
+#define NAU7802_TARE_SLOTS 16      //Slot 0 is "no tare" and always exists
+#define NAU7802_TARE_NAME_LENGTH 16
+
+//One container tare
+typedef struct
+{
+  char name[NAU7802_TARE_NAME_LENGTH]; //Optional, NUL terminated
+  int32_t offset;                      //Container reading above the zero offset, in counts
+  bool preset;                         //Entered as a known weight rather than measured
+  bool used;
+} NAU7802_Tare;
+
+//Everything needed to restore a scale's calibration from NVM
+typedef struct
+{
+  int32_t zeroOffset;
+  float calibrationFactor;
+  uint8_t activeTare;
+  NAU7802_Tare tares[NAU7802_TARE_SLOTS];
+} NAU7802_Calibration;
+
+#define NAU7802_FRAME_DEVICES 32 //Most devices readAll() takes at once
+
+//One reading from each of a set of devices, taken together by readAll()
+typedef struct
+{
+  uint8_t count;                                 //Devices asked for
+  uint8_t validCount;                            //Devices that had a new conversion
+  uint8_t ioctls;                                //I2C_RDWR calls it took
+  bool valid[NAU7802_FRAME_DEVICES];             //False if no conversion was ready or the transfer failed
+  NAU7802_Sample samples[NAU7802_FRAME_DEVICES]; //Same order as the devices
+} NAU7802_Frame;
+
 class NAU7802
 {
 public:
   NAU7802(uint8_t i2c_bus, uint8_t i2c_addr= 0x2A);                                               //Default constructor
+  NAU7802(uint8_t i2c_bus, NAU7802_Mux &mux, uint8_t muxChannel, uint8_t i2c_addr = 0x2A);        //Device behind channel muxChannel of an I2C mux
+  NAU7802(NAU7802_IIO &transport);                                                                //Device owned by the kernel nau7802 IIO driver. Register level calls fail
   ~NAU7802();                                              //Default destructor
   bool begin(bool initialize = true);      // Check communication and initialize sensor
   bool isConnected();                                      //Returns true if device acks at the I2C address
 
   bool available();                          //Returns true if Cycle Ready bit is set (conversion is complete)
   int32_t getReading();                      //Returns 24-bit reading. Assumes CR Cycle Ready bit (ADC conversion complete) has been checked by .available()
-  int32_t getAverage(uint8_t samplesToTake); //Return the average of a given number of readings
+  int32_t getAverage(uint8_t samplesToTake); //Return the average of a given number of readings. Chopped readings when chopping is on
+
+  bool setPolarityChopping(bool enable, uint8_t settleDiscards = 1); //Cancel front end offset by alternating PGA INV between readings of a pair
+  bool getPolarityChopping();
+  int32_t getChoppedReading(); //(non-inverted - inverted) / 2 of two conversions. Blocks for 2 + 2 * settleDiscards conversions, leaves INV clear
 
   void calculateZeroOffset(uint8_t averageAmount = 8); //Also called taring. Call this with nothing on the scale
   void setZeroOffset(int32_t newZeroOffset);           //Sets the internal variable. Useful for users who are loading values from NVM.
@@ -199,21 +323,66 @@ public:
 
   float getWeight(bool allowNegativeWeights = false, uint8_t samplesToTake = 8); //Once you've set zero offset and cal factor, you can ask the library to do the calculations for you.
 
+  bool setTare(uint8_t slot, int32_t offset, const char *name = nullptr);                 //Store a container tare in counts above zero offset
+  bool setPresetTare(uint8_t slot, float weight, const char *name = nullptr);             //Store a container tare as a known weight. Needs the cal factor
+  bool calculateTare(uint8_t slot, const char *name = nullptr, uint8_t averageAmount = 8); //Measure the container on the scale now. Blocks like calculateZeroOffset(). False on timeout
+  bool clearTare(uint8_t slot);
+  bool selectTare(uint8_t slot); //Switch the active container. Constant time, no I2C. Safe against toNetWeight() on other threads
+  uint8_t getActiveTare();
+  int findTare(const char *name); //Slot with this name, or -1
+  bool getTare(uint8_t slot, NAU7802_Tare &tare);
+
+  float getGrossWeight(bool allowNegativeWeights = false, uint8_t samplesToTake = 8); //Weight including the container. Same as getWeight()
+  float getNetWeight(bool allowNegativeWeights = false, uint8_t samplesToTake = 8);   //Weight minus the active container
+  float toGrossWeight(int32_t reading); //Convert a reading already taken. No I2C
+  float toNetWeight(int32_t reading);   //Convert a reading already taken, minus the active container. No I2C
+
+  void getCalibration(NAU7802_Calibration &calibration); //Zero offset, cal factor and tares, for storing into NVM
+  void setCalibration(const NAU7802_Calibration &calibration);
+
+  bool getLatest(NAU7802_Sample &sample) const; //Copy of the last reading taken by any thread. Lock free, never touches I2C. Returns false if no reading yet.
+  float getLatestWeight() const;                //Last weight computed by getWeight(). Lock free, never touches I2C.
+  static uint8_t readAll(NAU7802 *devices[], uint8_t count, NAU7802_Frame &frame); //Status and reading of every device on one adapter in as few I2C_RDWR calls as possible. Returns the number of new readings
+  size_t readBuffered(NAU7802_Sample *out, size_t maxSamples); //IIO transport only: every conversion the kernel has buffered, in one read(). Never blocks
+  void setDeviceTag(uint16_t tag);              //Tag stamped into every sample from this device
+  uint16_t getDeviceTag();
+  uint8_t getBus();     //I2C adapter number, the N in /dev/i2c-N
+  uint8_t getAddress(); //7-bit I2C address
+  NAU7802_Mux *getMux(); //Mux in front of this device, or nullptr
+  uint8_t getMuxChannel();
+
   bool setGain(uint8_t gainValue);        //Set the gain. x1, 2, 4, 8, 16, 32, 64, 128 are available
+  uint8_t getGain();                      //Last gain set with setGain(). Cached, does not touch I2C
   bool setLDO(uint8_t ldoValue);          //Set the onboard Low-Drop-Out voltage regulator to a given value. 2.4, 2.7, 3.0, 3.3, 3.6, 3.9, 4.2, 4.5V are avaialable
   bool setSampleRate(uint8_t rate);       //Set the readings per second. 10, 20, 40, 80, and 320 samples per second is available
+  uint8_t getSampleRate();                //Last rate set with setSampleRate(). Cached, does not touch I2C
+  uint32_t getConversionPeriod();         //Nominal time between conversions in microseconds at the current rate
   bool setChannel(uint8_t channelNumber); //Select between 1 and 2
 
-  bool calibrateAFE();                               //Synchronous calibration of the analog front end of the NAU7802. Returns true if CAL_ERR bit is 0 (no error)
-  void beginCalibrateAFE();                          //Begin asynchronous calibration of the analog front end of the NAU7802. Poll for completion with calAFEStatus() or wait with waitForCalibrateAFE().
+  bool calibrateAFE(uint8_t mode = NAU7802_CALMOD_INTERNAL);   //Synchronous calibration of the analog front end of the NAU7802. Returns true if CAL_ERR bit is 0 (no error)
+  void beginCalibrateAFE(uint8_t mode = NAU7802_CALMOD_INTERNAL); //Begin asynchronous calibration of the analog front end of the NAU7802. Poll for completion with calAFEStatus() or wait with waitForCalibrateAFE().
   bool waitForCalibrateAFE(uint32_t timeout_ms = 0); //Wait for asynchronous AFE calibration to complete with optional timeout.
   NAU7802_Cal_Status calAFEStatus();                 //Check calibration status.
 
+  bool calibrateSystemOffset();                   //Chip absorbs the empty scale reading into OCAL. Zero offset becomes 0. Kept across later internal calibrations
+  void clearSystemCalibration();                  //Stop re-applying the system offset after internal calibrations
+  bool calibrateSystemGain(float weightOnScale, float capacity); //Chip scales the input so capacity reads full scale, via GCAL. Sets the matching cal factor
+  int32_t getOffsetCalibration();                 //OCAL of the selected channel, for storing into NVM
+  bool setOffsetCalibration(int32_t offset);
+  uint32_t getGainCalibration();                  //GCAL of the selected channel, for storing into NVM
+  bool setGainCalibration(uint32_t gain);
+  bool verifyCalibration(NAU7802_Cal_Check &check, uint8_t averageAmount = 16, float tolerance = 0); //Compare the chip's calibrated output against the software model. Tolerance 0 derives it from the expected noise
+
   bool reset(); //Resets all registers to Power Of Defaults
 
   bool powerUp();   //Power up digital and analog sections of scale, ~2mA
   bool powerDown(); //Puts scale into low-power 200nA mode
 
+  bool setPowerProfile(uint8_t profile); //Program PGA, PGA_PWR and the PGA chopper together. Re-cal AFE afterwards
+  uint8_t getPowerProfile();             //Last profile set. Cached, does not touch I2C
+  bool measureProfile(NAU7802_Profile_Report &report, uint16_t samples = 64); //Noise and throughput of the current settings. Blocks while sampling
+  bool compareProfiles(uint8_t profileA, uint8_t profileB, NAU7802_Profile_Report reports[2], uint16_t samples = 64); //A/B measurement. Restores the original profile
+
   bool setIntPolarityHigh(); //Set Int pin to be high when data is ready (default)
   bool setIntPolarityLow();  //Set Int pin to be low when data is ready
 
@@ -229,13 +398,37 @@ public:
   unsigned long micros();
 
 private:
-  int fd;
-  uint8_t buffer[3];
+  bool average(uint8_t averageAmount, int32_t &value);      //getAverage() with timeouts reported
+  bool chopped(int32_t &value);                            //getChoppedReading() with timeouts reported
+  bool setInverted(bool inverted);                         //Write PGA INV, tracking it in chopInverted
+  bool discardSettling();                                  //Skip the conversions after a polarity flip
+  bool restoreInput();                                     //INV back off and settled
+  bool readConversion(int32_t &value);                     //ADCO read without publishing
+  uint8_t calRegister(uint8_t channel1Register);           //OCAL/GCAL register of the selected channel
+  bool waitConversion(int32_t &value, uint32_t timeout_ms); //Wait for CR then readConversion()
+  void publish(int32_t value);                             //Hand a reading to getLatest()
+  uint8_t takeFlags();                                     //Quality flags for the next published reading
+  bool transfer(struct i2c_msg *messages, uint32_t count); //Several messages in one I2C_RDWR
+  bool route(); //Point the shared adapter and mux at this device. No syscall if already there. Caller holds the adapter lock
+  int fd;           //Shared by every NAU7802 on the adapter
   uint8_t i2c_bus;  //I2C bus for NaU7802
   uint8_t i2c_addr; // Default unshifted 7-bit address of the NAU7802
   // y = mx+b
   int32_t _zeroOffset;      // This is b
   float _calibrationFactor; // This is m. User provides this number so that we can output y when requested
-  std::chrono::steady_clock::time_point refTime;
+  uint16_t _deviceTag;      // Copied into NAU7802_Sample::device
+  uint8_t _channel;         // Last channel selected with setChannel()
+  uint8_t _sampleRate;      // Last CRS value written by setSampleRate()
+  uint8_t _gain;            // Last gain written by setGain()
+  uint8_t _pendingFlags;    // NAU7802_FLAG_ bits for the next published reading
+  bool _calibrating;        // CALS set and not yet seen clear
+  uint8_t _muxChannel;      // Mux channel in front of this device
+  uint32_t _readCount;      // Copied into NAU7802_Sample::sequence
+  NAU7802_Latest _latest;   // Last reading and weight for lock free readers
+  std::atomic<int32_t> _activeTareOffset; // Copy of the active tare's offset for the per-sample path. Read from any thread
+  NAU7802_Mux *_mux;         // Selected before every transaction, nullptr if directly on the bus
+  NAU7802_IIO *_iio;         // Kernel driver transport, nullptr when talking i2c-dev
+  struct Cold;
+  Cold *_cold;               // Tares, calibration bookkeeping and chop state. Owned
 };
 #endif
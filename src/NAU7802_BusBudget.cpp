@@ -0,0 +1,190 @@
+/*
+  I2C bandwidth model and admission control for one bus.
+  See NAU7802_BusBudget.h for the model.
+*/
+
+#include "NAU7802_BusBudget.h"
+#include "NAU7802.h"
+
+NAU7802_BusBudget::NAU7802_BusBudget(uint32_t busClock_hz, float limit)
+{
+  this->busClock_hz = busClock_hz;
+  this->limit = limit;
+  pollsPerConversion = 1.5;
+  overhead_us = 50; //Typical i2c-dev ioctl round trip until real measurements arrive
+  for (uint8_t x = 0; x < 8; x++)
+    devicesAtRate[x] = 0;
+  rejects = 0;
+  windowStart_us = 0;
+  windowBusy_us = 0;
+  measuredUtilization = 0;
+}
+
+void NAU7802_BusBudget::setBusClock(uint32_t newClock_hz)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  if (newClock_hz > 0)
+    busClock_hz = newClock_hz;
+}
+
+void NAU7802_BusBudget::setLimit(float newLimit)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  limit = newLimit;
+}
+
+void NAU7802_BusBudget::setPollsPerConversion(float polls)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  pollsPerConversion = polls;
+}
+
+//Bits on the wire. Each byte is 8 data bits plus ACK; start, repeated start and stop add one bit time each.
+uint32_t NAU7802_BusBudget::getTransferBits(NAU7802_Transfer_Type type)
+{
+  switch (type)
+  {
+  case NAU7802_XFER_STATUS_POLL:
+    return (4 * 9 + 3); //Addr+W, register, Addr+R, data
+  case NAU7802_XFER_DATA_READ:
+    return (6 * 9 + 3); //Addr+W, ADCO_B2, Addr+R, 3 data bytes
+  case NAU7802_XFER_REGISTER_WRITE:
+    return (3 * 9 + 2); //Addr+W, register, data
+  case NAU7802_XFER_MUX_SELECT:
+    return (2 * 9 + 2); //Addr+W, channel mask
+  default:
+    return (0);
+  }
+}
+
+float NAU7802_BusBudget::transferTime(NAU7802_Transfer_Type type)
+{
+  return (getTransferBits(type) * 1E6f / busClock_hz + overhead_us);
+}
+
+float NAU7802_BusBudget::getTransferTime(NAU7802_Transfer_Type type)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return (transferTime(type));
+}
+
+float NAU7802_BusBudget::getOverhead()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return (overhead_us);
+}
+
+//Feed the time a real transaction took. The part not explained by wire time is per-ioctl overhead.
+void NAU7802_BusBudget::recordTransfer(NAU7802_Transfer_Type type, uint32_t measured_us)
+{
+  std::lock_guard<std::mutex> guard(lock);
+
+  float wire_us = getTransferBits(type) * 1E6f / busClock_hz;
+  float extra = measured_us - wire_us;
+  if (extra < 0)
+    extra = 0;
+  overhead_us += (extra - overhead_us) / 64; //Slow moving average, ignores the odd preempted call
+
+  uint64_t now = NAU7802_timestamp();
+  if (windowStart_us == 0)
+    windowStart_us = now;
+  windowBusy_us += measured_us;
+  if (now - windowStart_us >= 1000000)
+  {
+    measuredUtilization = (float)windowBusy_us / (now - windowStart_us);
+    windowStart_us = now;
+    windowBusy_us = 0;
+  }
+}
+
+float NAU7802_BusBudget::deviceLoad(uint8_t rate)
+{
+  float perConversion = transferTime(NAU7802_XFER_DATA_READ) + pollsPerConversion * transferTime(NAU7802_XFER_STATUS_POLL);
+  return (perConversion / NAU7802_conversionPeriod(rate));
+}
+
+float NAU7802_BusBudget::getDeviceLoad(uint8_t rate)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return (deviceLoad(rate & 0b111));
+}
+
+float NAU7802_BusBudget::plannedUtilization()
+{
+  float total = 0;
+  for (uint8_t x = 0; x < 8; x++)
+  {
+    if (devicesAtRate[x])
+      total += devicesAtRate[x] * deviceLoad(x);
+  }
+  return (total);
+}
+
+//Reserve bus time for a new device at this CRS rate
+bool NAU7802_BusBudget::admitDevice(uint8_t rate)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  rate &= 0b111;
+  if (plannedUtilization() + deviceLoad(rate) > limit)
+  {
+    rejects++;
+    return (false);
+  }
+  devicesAtRate[rate]++;
+  return (true);
+}
+
+//Move a device's reservation to a new rate. Lowering a rate always fits.
+bool NAU7802_BusBudget::admitRateChange(uint8_t oldRate, uint8_t newRate)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  oldRate &= 0b111;
+  newRate &= 0b111;
+  float after = plannedUtilization() - deviceLoad(oldRate) + deviceLoad(newRate);
+  if (after > limit && deviceLoad(newRate) > deviceLoad(oldRate))
+  {
+    rejects++;
+    return (false);
+  }
+  if (devicesAtRate[oldRate])
+    devicesAtRate[oldRate]--;
+  devicesAtRate[newRate]++;
+  return (true);
+}
+
+//Move a reservation without checking the limit, to follow a rate that is already in effect
+void NAU7802_BusBudget::moveDevice(uint8_t oldRate, uint8_t newRate)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  oldRate &= 0b111;
+  newRate &= 0b111;
+  if (devicesAtRate[oldRate])
+    devicesAtRate[oldRate]--;
+  devicesAtRate[newRate]++;
+}
+
+void NAU7802_BusBudget::releaseDevice(uint8_t rate)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  rate &= 0b111;
+  if (devicesAtRate[rate])
+    devicesAtRate[rate]--;
+}
+
+float NAU7802_BusBudget::getPlannedUtilization()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return (plannedUtilization());
+}
+
+float NAU7802_BusBudget::getMeasuredUtilization()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return (measuredUtilization);
+}
+
+uint32_t NAU7802_BusBudget::getRejectCount()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return (rejects);
+}
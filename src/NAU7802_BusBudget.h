@@ -0,0 +1,74 @@
+/*
+  I2C bandwidth model and admission control for one bus.
+
+  Every NAU7802 transaction has a fixed shape on the wire (address, register
+  pointer, repeated start, data), so its cost is its bit count at the bus
+  clock plus the host's per-ioctl overhead. The overhead is measured from
+  real transactions as they run. From the cost of a status poll and a data
+  read the model derives the bus time a device needs at a given sample rate,
+  and refuses new devices or rate changes that would push the bus past its
+  utilization limit. Measured utilization is reported alongside the plan so
+  an oversubscribed bus shows up before samples go missing.
+
+  All calls are thread safe.
+*/
+
+#ifndef _NAU7802_BusBudget_h
+#define _NAU7802_BusBudget_h
+
+#include <stdint.h>
+#include <mutex>
+
+//Transaction shapes the library puts on the bus
+typedef enum
+{
+  NAU7802_XFER_STATUS_POLL = 0, //Register read, e.g. available() checking CR
+  NAU7802_XFER_DATA_READ,       //3 byte ADCO block read
+  NAU7802_XFER_REGISTER_WRITE,  //Single register write
+  NAU7802_XFER_MUX_SELECT,      //Channel byte written to an I2C mux
+  NAU7802_XFER_TYPES,
+} NAU7802_Transfer_Type;
+
+class NAU7802_BusBudget
+{
+public:
+  NAU7802_BusBudget(uint32_t busClock_hz = 100000, float limit = 0.7);
+
+  void setBusClock(uint32_t busClock_hz);
+  void setLimit(float limit);            //Highest planned utilization admit() accepts, 0 to 1
+  void setPollsPerConversion(float polls); //Status polls expected per conversion read. Default 1.5
+
+  static uint32_t getTransferBits(NAU7802_Transfer_Type type); //Bits on the wire including start/stop
+  float getTransferTime(NAU7802_Transfer_Type type);           //Microseconds including measured overhead
+  float getOverhead();                                         //Measured per-ioctl overhead in microseconds
+  void recordTransfer(NAU7802_Transfer_Type type, uint32_t measured_us); //Feed a timed transaction
+
+  float getDeviceLoad(uint8_t rate); //Fraction of bus time one device needs at this CRS rate
+
+  bool admitDevice(uint8_t rate);                    //Reserve bandwidth for a new device. False if it doesn't fit
+  bool admitRateChange(uint8_t oldRate, uint8_t newRate); //Move a device's reservation. False (and unchanged) if it doesn't fit
+  void moveDevice(uint8_t oldRate, uint8_t newRate);  //Move a reservation unconditionally, e.g. to follow a rate already set
+  void releaseDevice(uint8_t rate);                  //Return a device's reservation
+
+  float getPlannedUtilization();  //Sum of reservations, using the current cost model
+  float getMeasuredUtilization(); //Fraction of the last full second spent in recorded transactions
+  uint32_t getRejectCount();
+
+private:
+  float transferTime(NAU7802_Transfer_Type type);
+  float deviceLoad(uint8_t rate);
+  float plannedUtilization();
+
+  std::mutex lock;
+  uint32_t busClock_hz;
+  float limit;
+  float pollsPerConversion;
+  float overhead_us;
+  uint32_t devicesAtRate[8]; //Reservations indexed by CRS value
+  uint32_t rejects;
+  uint64_t windowStart_us;
+  uint64_t windowBusy_us;
+  float measuredUtilization;
+};
+
+#endif
@@ -0,0 +1,258 @@
+/*
+  C interface to NAU7802_Fleet for Go, Rust and other FFI callers.
+  See NAU7802_C.h for the design.
+*/
+
+#include "NAU7802_C.h"
+#include "NAU7802_Fleet.h"
+
+#include <stddef.h>
+#include <new>
+
+static_assert(sizeof(nau7802_sample) == sizeof(NAU7802_Sample), "nau7802_sample must match NAU7802_Sample");
+static_assert(offsetof(nau7802_sample, value) == offsetof(NAU7802_Sample, value), "nau7802_sample layout");
+static_assert(offsetof(nau7802_sample, device) == offsetof(NAU7802_Sample, device), "nau7802_sample layout");
+static_assert(offsetof(nau7802_sample, channel) == offsetof(NAU7802_Sample, channel), "nau7802_sample layout");
+static_assert(offsetof(nau7802_sample, flags) == offsetof(NAU7802_Sample, flags), "nau7802_sample layout");
+static_assert(offsetof(nau7802_sample, sequence) == offsetof(NAU7802_Sample, sequence), "nau7802_sample layout");
+
+static_assert(NAU7802_C_FLAG_SATURATED == NAU7802_FLAG_SATURATED, "flag values must match");
+static_assert(NAU7802_C_FLAG_SETTLING == NAU7802_FLAG_SETTLING, "flag values must match");
+static_assert(NAU7802_C_FLAG_RETRIED == NAU7802_FLAG_RETRIED, "flag values must match");
+static_assert(NAU7802_C_FLAG_LATE == NAU7802_FLAG_LATE, "flag values must match");
+static_assert(NAU7802_C_FLAG_CALIBRATING == NAU7802_FLAG_CALIBRATING, "flag values must match");
+static_assert(NAU7802_C_FLAG_INTERPOLATED == NAU7802_FLAG_INTERPOLATED, "flag values must match");
+
+struct nau7802_fleet : NAU7802_Fleet
+{
+  nau7802_fleet(uint32_t capacity) : NAU7802_Fleet(capacity) {}
+};
+
+struct nau7802_mux : NAU7802_Mux
+{
+  nau7802_mux(uint8_t i2c_bus, uint8_t i2c_addr) : NAU7802_Mux(i2c_bus, i2c_addr) {}
+};
+
+uint32_t nau7802_api_version(void)
+{
+  return (NAU7802_C_API_VERSION);
+}
+
+nau7802_fleet *nau7802_fleet_create(uint32_t capacity)
+{
+  if (capacity > NAU7802_FLEET_MAX_CELLS)
+    return (nullptr); //Cell indexes wouldn't fit nau7802_sample.device
+  try
+  {
+    return (new nau7802_fleet(capacity));
+  }
+  catch (...)
+  {
+    return (nullptr); //Reserving the arrays failed
+  }
+}
+
+void nau7802_fleet_destroy(nau7802_fleet *fleet)
+{
+  delete fleet;
+}
+
+int nau7802_fleet_add(nau7802_fleet *fleet, uint8_t i2c_bus, uint8_t i2c_addr)
+{
+  if (fleet == nullptr)
+    return (-1);
+  try
+  {
+    return (fleet->add(i2c_bus, i2c_addr));
+  }
+  catch (...)
+  {
+    return (-1);
+  }
+}
+
+int nau7802_fleet_add_muxed(nau7802_fleet *fleet, uint8_t i2c_bus, nau7802_mux *mux, uint8_t mux_channel, uint8_t i2c_addr)
+{
+  if (fleet == nullptr || mux == nullptr)
+    return (-1);
+  try
+  {
+    return (fleet->add(i2c_bus, *mux, mux_channel, i2c_addr));
+  }
+  catch (...)
+  {
+    return (-1);
+  }
+}
+
+int nau7802_fleet_begin(nau7802_fleet *fleet, int initialize)
+{
+  if (fleet == nullptr)
+    return (0);
+  try
+  {
+    return (fleet->begin(initialize != 0));
+  }
+  catch (...)
+  {
+    return (0);
+  }
+}
+
+uint32_t nau7802_fleet_count(nau7802_fleet *fleet)
+{
+  if (fleet == nullptr)
+    return (0);
+  return (fleet->getCount());
+}
+
+nau7802_mux *nau7802_mux_create(uint8_t i2c_bus, uint8_t i2c_addr)
+{
+  return (new (std::nothrow) nau7802_mux(i2c_bus, i2c_addr));
+}
+
+int nau7802_mux_begin(nau7802_mux *mux)
+{
+  if (mux == nullptr)
+    return (0);
+  return (mux->begin());
+}
+
+void nau7802_mux_destroy(nau7802_mux *mux)
+{
+  delete mux;
+}
+
+int nau7802_fleet_set_gain(nau7802_fleet *fleet, uint32_t cell, uint8_t gain)
+{
+  if (fleet == nullptr || fleet->getDevice(cell) == nullptr)
+    return (0);
+  try
+  {
+    return (fleet->getDevice(cell)->setGain(gain));
+  }
+  catch (...)
+  {
+    return (0);
+  }
+}
+
+int nau7802_fleet_set_sample_rate(nau7802_fleet *fleet, uint32_t cell, uint8_t rate)
+{
+  if (fleet == nullptr || fleet->getDevice(cell) == nullptr)
+    return (0);
+  try
+  {
+    return (fleet->getDevice(cell)->setSampleRate(rate));
+  }
+  catch (...)
+  {
+    return (0);
+  }
+}
+
+int nau7802_fleet_calibrate_afe(nau7802_fleet *fleet, uint32_t cell)
+{
+  if (fleet == nullptr || fleet->getDevice(cell) == nullptr)
+    return (0);
+  try
+  {
+    return (fleet->getDevice(cell)->calibrateAFE());
+  }
+  catch (...)
+  {
+    return (0);
+  }
+}
+
+int nau7802_fleet_set_calibration(nau7802_fleet *fleet, uint32_t cell, int32_t zero_offset, float calibration_factor)
+{
+  if (fleet == nullptr || cell >= fleet->getCount() || calibration_factor == 0)
+    return (0);
+  fleet->setZeroOffset(cell, zero_offset);
+  fleet->setCalibrationFactor(cell, calibration_factor);
+  return (1);
+}
+
+uint32_t nau7802_fleet_poll(nau7802_fleet *fleet)
+{
+  if (fleet == nullptr)
+    return (0);
+  try
+  {
+    return (fleet->poll());
+  }
+  catch (...)
+  {
+    return (0);
+  }
+}
+
+//Version 1 signature, kept for existing callers
+uint32_t nau7802_fleet_read(nau7802_fleet *fleet, int32_t *values, uint64_t *timestamps, uint8_t *fresh, uint32_t max_cells)
+{
+  return (nau7802_fleet_read_flags(fleet, values, timestamps, nullptr, fresh, max_cells));
+}
+
+//Returns the number of cells copied
+uint32_t nau7802_fleet_read_flags(nau7802_fleet *fleet, int32_t *values, uint64_t *timestamps, uint8_t *flags, uint8_t *fresh, uint32_t max_cells)
+{
+  if (fleet == nullptr)
+    return (0);
+
+  uint32_t count = fleet->getCount();
+  if (count > max_cells)
+    count = max_cells;
+  if (values != nullptr)
+    memcpy(values, fleet->getValues(), count * sizeof(int32_t));
+  if (timestamps != nullptr)
+    memcpy(timestamps, fleet->getTimestamps(), count * sizeof(uint64_t));
+  if (flags != nullptr)
+    memcpy(flags, fleet->getFlags(), count * sizeof(uint8_t));
+  if (fresh != nullptr)
+    memcpy(fresh, fleet->getFresh(), count * sizeof(uint8_t));
+  return (count);
+}
+
+size_t nau7802_fleet_drain(nau7802_fleet *fleet, nau7802_sample *samples, float *weights, size_t max_samples, uint32_t timeout_ms)
+{
+  if (fleet == nullptr || samples == nullptr)
+    return (0);
+
+  try
+  {
+    NAU7802_Sample *out = reinterpret_cast<NAU7802_Sample *>(samples);
+    size_t count = fleet->collect(out, max_samples, timeout_ms);
+    if (weights != nullptr)
+      fleet->convert(out, weights, count);
+    return (count);
+  }
+  catch (...)
+  {
+    return (0);
+  }
+}
+
+uint32_t nau7802_fleet_weights(nau7802_fleet *fleet, float *weights, uint32_t max_cells)
+{
+  if (fleet == nullptr || weights == nullptr)
+    return (0);
+
+  uint32_t count = fleet->getCount();
+  if (count > max_cells)
+    count = max_cells;
+  fleet->convert(0, count, weights);
+  return (count);
+}
+
+void nau7802_fleet_convert(nau7802_fleet *fleet, const nau7802_sample *samples, float *weights, size_t count)
+{
+  if (fleet == nullptr || samples == nullptr || weights == nullptr)
+    return;
+  fleet->convert(reinterpret_cast<const NAU7802_Sample *>(samples), weights, count);
+}
+
+void nau7802_convert(const int32_t *values, const int32_t *offsets, const float *inverse_factors, float *weights, uint32_t count)
+{
+  NAU7802_Fleet::convert(values, offsets, inverse_factors, weights, count);
+}
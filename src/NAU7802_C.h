@@ -0,0 +1,89 @@
+/*
+  C interface to NAU7802_Fleet for Go, Rust and other FFI callers.
+
+  Every call that moves samples works on whole arrays, so a foreign caller
+  crosses the boundary once per batch instead of once per cell or sample.
+  Handles are opaque; the library allocates and frees them. Functions
+  returning int give 1 for success and 0 for failure, like the bool results
+  of the C++ API. No C++ exception ever leaves this interface: an entry
+  point that hits one (out of memory) reports failure instead.
+
+  `make lib` builds bin/libnau7802.a and bin/libnau7802.so for linking from
+  other languages.
+
+  The layout of nau7802_sample and the NAU7802_C_FLAG_ values match
+  NAU7802_Sample.h and are checked at compile time. Signatures never change
+  once published; NAU7802_C_API_VERSION goes up when entry points are added.
+  Version 2 added nau7802_fleet_read_flags() and the sample flags byte
+  (reserved in version 1).
+*/
+
+#ifndef _NAU7802_C_h
+#define _NAU7802_C_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NAU7802_C_API_VERSION 2
+
+//Sample flags, same values as NAU7802_Sample.h
+#define NAU7802_C_FLAG_SATURATED 0x01
+#define NAU7802_C_FLAG_SETTLING 0x02
+#define NAU7802_C_FLAG_RETRIED 0x04
+#define NAU7802_C_FLAG_LATE 0x08
+#define NAU7802_C_FLAG_CALIBRATING 0x10
+#define NAU7802_C_FLAG_INTERPOLATED 0x20
+
+typedef struct nau7802_fleet nau7802_fleet;
+typedef struct nau7802_mux nau7802_mux;
+
+typedef struct
+{
+  uint64_t timestamp_us; //Steady clock microseconds
+  int32_t value;         //Raw 24-bit reading, sign extended
+  uint16_t device;       //Cell index in the fleet
+  uint8_t channel;
+  uint8_t flags; //NAU7802_FLAG_ bits from NAU7802_Sample.h
+  uint32_t sequence;
+  uint32_t padding;
+} nau7802_sample;
+
+uint32_t nau7802_api_version(void);
+
+nau7802_fleet *nau7802_fleet_create(uint32_t capacity); //NULL if out of memory or capacity is above 65535
+void nau7802_fleet_destroy(nau7802_fleet *fleet);
+int nau7802_fleet_add(nau7802_fleet *fleet, uint8_t i2c_bus, uint8_t i2c_addr); //Cell index, or -1 when full
+int nau7802_fleet_add_muxed(nau7802_fleet *fleet, uint8_t i2c_bus, nau7802_mux *mux, uint8_t mux_channel, uint8_t i2c_addr);
+int nau7802_fleet_begin(nau7802_fleet *fleet, int initialize);
+uint32_t nau7802_fleet_count(nau7802_fleet *fleet);
+
+nau7802_mux *nau7802_mux_create(uint8_t i2c_bus, uint8_t i2c_addr); //Must outlive the fleet cells behind it
+int nau7802_mux_begin(nau7802_mux *mux);
+void nau7802_mux_destroy(nau7802_mux *mux);
+
+//Per cell configuration (cold path)
+int nau7802_fleet_set_gain(nau7802_fleet *fleet, uint32_t cell, uint8_t gain);       //NAU7802_GAIN value
+int nau7802_fleet_set_sample_rate(nau7802_fleet *fleet, uint32_t cell, uint8_t rate); //NAU7802_SPS value
+int nau7802_fleet_calibrate_afe(nau7802_fleet *fleet, uint32_t cell);
+int nau7802_fleet_set_calibration(nau7802_fleet *fleet, uint32_t cell, int32_t zero_offset, float calibration_factor);
+
+//Batch acquisition
+uint32_t nau7802_fleet_poll(nau7802_fleet *fleet); //Read every cell once. Returns new readings
+uint32_t nau7802_fleet_read(nau7802_fleet *fleet, int32_t *values, uint64_t *timestamps, uint8_t *fresh, uint32_t max_cells); //Copy the last poll; any pointer may be NULL
+uint32_t nau7802_fleet_read_flags(nau7802_fleet *fleet, int32_t *values, uint64_t *timestamps, uint8_t *flags, uint8_t *fresh, uint32_t max_cells); //Same, plus NAU7802_C_FLAG_ bits per cell
+size_t nau7802_fleet_drain(nau7802_fleet *fleet, nau7802_sample *samples, float *weights, size_t max_samples, uint32_t timeout_ms); //Poll until max_samples or timeout. weights may be NULL
+
+//Batch conversion
+uint32_t nau7802_fleet_weights(nau7802_fleet *fleet, float *weights, uint32_t max_cells); //Weight of every cell's last reading
+void nau7802_fleet_convert(nau7802_fleet *fleet, const nau7802_sample *samples, float *weights, size_t count); //Weights of drained samples
+void nau7802_convert(const int32_t *values, const int32_t *offsets, const float *inverse_factors, float *weights, uint32_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,189 @@
+/*
+  Host/ADC clock relationship estimator for one NAU7802.
+  See NAU7802_Clock.h for the method.
+*/
+
+#include "NAU7802_Clock.h"
+
+#include <math.h>
+
+#define NAU7802_CLOCK_MIN_JITTER_US 50 //Smallest allowance for host timer and scheduling noise
+#define NAU7802_CLOCK_TOLERANCE 0.01   //How far the ADC oscillator may run from its nominal rate
+#define NAU7802_CLOCK_MIN_POINTS 12    //Fitted reads before the slope replaces the period
+#define NAU7802_CLOCK_RELOCK 64        //Late reads in a row before the fit starts over
+
+NAU7802_ClockEstimator::NAU7802_ClockEstimator(uint32_t nominalPeriod_us, float forgetting)
+{
+  this->forgetting = forgetting;
+  reset(nominalPeriod_us);
+}
+
+void NAU7802_ClockEstimator::reset(uint32_t newPeriod_us)
+{
+  nominalPeriod_us = newPeriod_us;
+  sw = sx = sy = sxx = sxy = 0;
+  period = newPeriod_us;
+  envelope = 0;
+  jitter = newPeriod_us; //Wide open until fitted reads show how noisy they are
+  lastArrival_us = 0;
+  lastIdeal_us = 0;
+  lateRun = 0;
+  conversions = 0;
+  skipped = 0;
+  late = 0;
+  points = 0;
+  publishedPeriod.store(period, std::memory_order_relaxed);
+}
+
+//Feed the host time a conversion was read
+//Returns the estimated host time at which that conversion completed
+uint64_t NAU7802_ClockEstimator::update(uint64_t arrival_us)
+{
+  if (points == 0)
+  {
+    lastArrival_us = arrival_us;
+    lastIdeal_us = arrival_us;
+    conversions = 1;
+    points = 1;
+    sw = 1; //Single point at the origin
+    return (arrival_us);
+  }
+
+  //The read returned the newest conversion: the last one on the fitted timeline before the arrival.
+  //Normally one step; more means some were overwritten. An arrival a little early against the
+  //timeline is jitter, not the previous conversion.
+  double limit = getJitterLimit();
+  double steps = floor(((double)arrival_us - lastIdeal_us + limit) / period);
+  if (steps < 1)
+    steps = 1;
+  conversions += (uint64_t)steps;
+  skipped += (uint64_t)steps - 1;
+
+  //Nothing has fitted for a long time: the line is lost. Start a new one here, keeping the period.
+  if (lateRun >= NAU7802_CLOCK_RELOCK)
+  {
+    sx = sy = sxx = sxy = 0;
+    sw = 1;
+    points = 1;
+    jitter = period;
+    lateRun = 0;
+    late++;
+    lastArrival_us = arrival_us;
+    lastIdeal_us = arrival_us;
+    return (arrival_us);
+  }
+
+  //Move the origin to the new point: x -= steps, y -= dy
+  double dy = (double)(arrival_us - lastArrival_us);
+  double dx = steps;
+  sxy = sxy - dy * sx - dx * sy + dx * dy * sw;
+  sxx = sxx - 2 * dx * sx + dx * dx * sw;
+  sx = sx - dx * sw;
+  sy = sy - dy * sw;
+  lastArrival_us = arrival_us;
+
+  //How far this read landed from the fitted line. Past the jitter allowance the read was simply
+  //slow and the arrival only bounds the conversion time, so it stays out of the fit. Judging
+  //against the line rather than the floor keeps outliers from dragging the floor with them.
+  double offset = -(sy - period * sx) / sw;
+  bool fits = fabs(offset) <= limit;
+  if (fits)
+  {
+    //Age the history, then add the new point at (0, 0)
+    sw = sw * forgetting + 1;
+    sx *= forgetting;
+    sy *= forgetting;
+    sxx *= forgetting;
+    sxy *= forgetting;
+    points++;
+    jitter += (fabs(offset) - jitter) * 0.01;
+    lateRun = 0;
+  }
+  else
+  {
+    late++;
+    lateRun++;
+  }
+
+  double denominator = sw * sxx - sx * sx;
+  if (fits && points >= NAU7802_CLOCK_MIN_POINTS && denominator > 1E-9)
+  {
+    //The oscillator can't be further off than its tolerance. A steeper or shallower line comes
+    //from a slow reader or a young fit, and the period stays where it was.
+    double slope = (sw * sxy - sx * sy) / denominator;
+    if (fabs(slope - nominalPeriod_us) <= nominalPeriod_us * NAU7802_CLOCK_TOLERANCE)
+      period = slope;
+  }
+  publishedPeriod.store(period, std::memory_order_relaxed);
+
+  double intercept = (sy - period * sx) / sw; //Fitted y at the newest point, relative to its arrival
+
+  //Residual of this arrival above the fitted line is latency plus jitter; track its floor.
+  //The floor relaxes slowly upward so a one-off early outlier doesn't stick forever.
+  if (fits)
+  {
+    double residual = -intercept;
+    if (points == 2 || residual < envelope)
+      envelope = residual;
+    else
+      envelope += (residual - envelope) * 0.001;
+  }
+
+  double ideal = (double)arrival_us + intercept + envelope;
+  lastIdeal_us = ideal;
+  if (ideal > (double)arrival_us)
+    ideal = (double)arrival_us; //A conversion can't complete after it was read
+  return ((uint64_t)ideal);
+}
+
+double NAU7802_ClockEstimator::getPeriod()
+{
+  return (publishedPeriod.load(std::memory_order_relaxed));
+}
+
+double NAU7802_ClockEstimator::getSampleRate()
+{
+  return (1E6 / getPeriod());
+}
+
+//Positive when the ADC runs slow against the host clock
+double NAU7802_ClockEstimator::getDriftPpm()
+{
+  return ((getPeriod() / nominalPeriod_us - 1.0) * 1E6);
+}
+
+uint64_t NAU7802_ClockEstimator::getConversionCount()
+{
+  return (conversions);
+}
+
+uint64_t NAU7802_ClockEstimator::getSkipped()
+{
+  return (skipped);
+}
+
+uint64_t NAU7802_ClockEstimator::getLate()
+{
+  return (late);
+}
+
+//Four times the mean jitter of fitted reads. Never less than the oscillator tolerance, so a young
+//fit can follow the real rate, and never more than 1/16 of a period, so reads spread evenly over
+//the period by a slow reader can't widen it for themselves.
+double NAU7802_ClockEstimator::getJitterLimit()
+{
+  double limit = 4 * jitter;
+  double least = period * NAU7802_CLOCK_TOLERANCE;
+  if (least < NAU7802_CLOCK_MIN_JITTER_US)
+    least = NAU7802_CLOCK_MIN_JITTER_US;
+  if (limit > period / 16)
+    limit = period / 16;
+  if (limit < least)
+    limit = least;
+  return (limit);
+}
+
+uint32_t NAU7802_ClockEstimator::getNominalPeriod()
+{
+  return (nominalPeriod_us);
+}
@@ -0,0 +1,72 @@
+/*
+  Host/ADC clock relationship estimator for one NAU7802.
+
+  The NAU7802 converts on its own oscillator, which runs a little fast or
+  slow against the host clock, and the host only sees a conversion when it
+  gets around to reading it. This estimator counts conversions (including
+  any that were overwritten between reads) and fits arrival time against
+  conversion number with an exponentially weighted least squares line. The
+  slope is the true conversion period on the host clock. Read latency only
+  ever adds delay, so the line is lowered to the lower envelope of the
+  residuals to recover when conversions actually completed.
+
+  A read returns the newest conversion, so the conversions since the last
+  one are counted by how many whole periods of the fitted timeline fit
+  before the arrival, not by rounding the gap between reads. An arrival
+  further past its conversion than the jitter allowance says nothing
+  precise about when that conversion happened: it is counted but kept out
+  of the fit, so a reader slower than the ADC still measures the ADC's rate
+  and sees the conversions it missed. Arrivals alone can't tell a slow
+  reader from an ADC running slow, so the fit starts from the nominal rate
+  and follows the oscillator only within 1% of it. After a long run of
+  late reads the fit starts over from the newest arrival.
+
+  update() is constant time and allocation free. It must be called from one
+  thread; the rate getters may be called from any thread.
+*/
+
+#ifndef _NAU7802_Clock_h
+#define _NAU7802_Clock_h
+
+#include <stdint.h>
+#include <atomic>
+
+class NAU7802_ClockEstimator
+{
+public:
+  NAU7802_ClockEstimator(uint32_t nominalPeriod_us = 12500, float forgetting = 0.995);
+
+  void reset(uint32_t nominalPeriod_us); //Start over, e.g. after a rate change
+  uint64_t update(uint64_t arrival_us);  //Feed a read time. Returns the reconstructed conversion time
+
+  double getPeriod();           //Estimated conversion period in host microseconds
+  double getSampleRate();       //Estimated true samples per second
+  double getDriftPpm();         //Oscillator error against the nominal rate, parts per million
+  uint64_t getConversionCount(); //Conversions since reset, including skipped ones
+  uint64_t getSkipped();         //Conversions that were never read
+  uint64_t getLate();            //Reads too long after their conversion to join the fit
+  double getJitterLimit();       //Microseconds off the fitted line an arrival may land and still join the fit
+  uint32_t getNominalPeriod();
+
+private:
+  uint32_t nominalPeriod_us;
+  double forgetting;
+
+  //Weighted sums with the newest point at the origin
+  double sw, sx, sy, sxx, sxy;
+  double period;
+  double envelope; //Lowest recent residual: the read latency floor
+  double jitter;   //Mean distance of fitted arrivals from the line
+
+  uint64_t lastArrival_us;
+  double lastIdeal_us; //Reconstructed time of the last conversion read, before clamping to its arrival
+  uint64_t conversions;
+  uint64_t skipped;
+  uint64_t late;
+  uint32_t lateRun; //Late reads since the last fitted one
+  uint32_t points;
+
+  std::atomic<double> publishedPeriod;
+};
+
+#endif
@@ -0,0 +1,229 @@
+/*
+  Load cell creep compensation for NAU7802 readings.
+  See NAU7802_Creep.h for the model.
+*/
+
+#include "NAU7802_Creep.h"
+
+#include <math.h>
+
+NAU7802_Creep::NAU7802_Creep()
+{
+  zero = 0;
+  clearTerms();
+}
+
+void NAU7802_Creep::setZeroOffset(int32_t zeroOffset)
+{
+  zero = zeroOffset;
+}
+
+//Set one term. Terms must be filled in order. Returns false if index is out of range.
+bool NAU7802_Creep::setTerm(uint8_t index, float newAmplitude, float tau_s)
+{
+  if (index >= NAU7802_MAX_CREEP_TERMS || index > terms || tau_s <= 0)
+    return (false);
+
+  amplitude[index] = newAmplitude;
+  tau[index] = tau_s;
+  if (index == terms)
+  {
+    state[index] = 0;
+    terms++;
+  }
+  lastDt_us = 0; //Recompute decay factors
+  return (true);
+}
+
+void NAU7802_Creep::clearTerms()
+{
+  terms = 0;
+  reset();
+}
+
+void NAU7802_Creep::reset()
+{
+  for (uint8_t x = 0; x < NAU7802_MAX_CREEP_TERMS; x++)
+    state[x] = 0;
+  lastDt_us = 0;
+  lastTime_us = 0;
+  primed = false;
+}
+
+//Feed a raw reading and return it with the predicted creep removed
+int32_t NAU7802_Creep::update(const NAU7802_Sample &sample)
+{
+  float creep = getCreep();
+  float corrected = sample.value - creep;
+
+  if (primed == false)
+  {
+    //Assume the current load has been in place long enough to have fully crept
+    float load = corrected - zero;
+    float total = 0;
+    for (uint8_t x = 0; x < terms; x++)
+      total += amplitude[x];
+    load /= (1 + total);
+    for (uint8_t x = 0; x < terms; x++)
+      state[x] = amplitude[x] * load;
+    lastTime_us = sample.timestamp_us;
+    primed = true;
+    return ((int32_t)lrintf(sample.value - getCreep()));
+  }
+
+  uint32_t dt = (uint32_t)(sample.timestamp_us - lastTime_us);
+  lastTime_us = sample.timestamp_us;
+  if (dt != lastDt_us)
+  {
+    //Rates are fixed, so this normally runs once
+    for (uint8_t x = 0; x < terms; x++)
+      decay[x] = 1 - expf(-(dt * 1E-6f) / tau[x]);
+    lastDt_us = dt;
+  }
+
+  //Every term relaxes toward its share of the load now on the cell
+  float load = corrected - zero;
+  for (uint8_t x = 0; x < terms; x++)
+    state[x] += (amplitude[x] * load - state[x]) * decay[x];
+
+  return ((int32_t)lrintf(sample.value - getCreep()));
+}
+
+NAU7802_Sample NAU7802_Creep::compensate(const NAU7802_Sample &sample)
+{
+  NAU7802_Sample corrected = sample;
+  corrected.value = update(sample);
+  return (corrected);
+}
+
+float NAU7802_Creep::getCreep()
+{
+  float total = 0;
+  for (uint8_t x = 0; x < terms; x++)
+    total += state[x];
+  return (total);
+}
+
+//Gaussian elimination with partial pivoting on an n x (n+1) augmented matrix
+bool NAU7802_Creep::solve(double matrix[][NAU7802_MAX_CREEP_TERMS + 2], uint8_t n, double *solution)
+{
+  for (uint8_t col = 0; col < n; col++)
+  {
+    uint8_t pivot = col;
+    for (uint8_t row = col + 1; row < n; row++)
+    {
+      if (fabs(matrix[row][col]) > fabs(matrix[pivot][col]))
+        pivot = row;
+    }
+    if (fabs(matrix[pivot][col]) < 1E-12)
+      return (false); //Time constants too close together for this data
+
+    for (uint8_t k = 0; k <= n; k++)
+    {
+      double swap = matrix[col][k];
+      matrix[col][k] = matrix[pivot][k];
+      matrix[pivot][k] = swap;
+    }
+
+    for (uint8_t row = col + 1; row < n; row++)
+    {
+      double factor = matrix[row][col] / matrix[col][col];
+      for (uint8_t k = col; k <= n; k++)
+        matrix[row][k] -= factor * matrix[col][k];
+    }
+  }
+
+  for (int row = n - 1; row >= 0; row--)
+  {
+    double sum = matrix[row][n];
+    for (uint8_t k = row + 1; k < n; k++)
+      sum -= matrix[row][k] * solution[k];
+    solution[row] = sum / matrix[row][row];
+  }
+  return (true);
+}
+
+//Fit amplitudes for fixed time constants to a step test
+//After the step the reading is modelled as b + sum c[i] * (1 - exp(-t / tau[i])), linear in b and c.
+//The step size is b minus the mean before the step, and amplitude[i] = c[i] / step.
+bool NAU7802_Creep::fit(const NAU7802_Sample *samples, size_t count, size_t stepIndex, const float *taus_s, uint8_t newTerms, uint64_t step_us)
+{
+  if (newTerms == 0 || newTerms > NAU7802_MAX_CREEP_TERMS || stepIndex == 0 || stepIndex + newTerms + 2 > count)
+    return (false);
+
+  double before = 0;
+  for (size_t x = 0; x < stepIndex; x++)
+    before += samples[x].value;
+  before /= stepIndex;
+
+  //Normal equations for the unknowns b, c[0..terms)
+  uint8_t n = newTerms + 1;
+  double matrix[NAU7802_MAX_CREEP_TERMS + 1][NAU7802_MAX_CREEP_TERMS + 2] = {{0}};
+  double basis[NAU7802_MAX_CREEP_TERMS + 1];
+  uint64_t origin = step_us ? step_us : samples[stepIndex].timestamp_us; //Creep starts with the load, not when sampling resumes
+
+  for (size_t x = stepIndex; x < count; x++)
+  {
+    double t = (samples[x].timestamp_us - origin) * 1E-6;
+    basis[0] = 1;
+    for (uint8_t k = 0; k < newTerms; k++)
+      basis[k + 1] = 1 - exp(-t / taus_s[k]);
+
+    for (uint8_t row = 0; row < n; row++)
+    {
+      for (uint8_t col = 0; col < n; col++)
+        matrix[row][col] += basis[row] * basis[col];
+      matrix[row][n] += basis[row] * samples[x].value;
+    }
+  }
+
+  double solution[NAU7802_MAX_CREEP_TERMS + 1];
+  if (solve(matrix, n, solution) == false)
+    return (false);
+
+  double step = solution[0] - before;
+  if (fabs(step) < 1)
+    return (false); //No load change to learn from
+
+  clearTerms();
+  for (uint8_t k = 0; k < newTerms; k++)
+    setTerm(k, solution[k + 1] / step, taus_s[k]);
+  return (true);
+}
+
+//Fit from an event capture whose trigger marks the load change
+//settleSamples after the trigger are skipped while the mechanics ring down
+bool NAU7802_Creep::fit(const NAU7802_Capture &capture, uint32_t settleSamples, const float *taus_s, uint8_t newTerms)
+{
+  if (capture.count == 0 || capture.trigger + settleSamples >= capture.count)
+    return (false);
+
+  //Captures are rings; lay the samples out in order, skipping the settling ones
+  NAU7802_Sample *ordered = new NAU7802_Sample[capture.count];
+  size_t used = 0;
+  for (uint32_t x = 0; x < capture.count; x++)
+  {
+    if (x >= capture.trigger && x < capture.trigger + settleSamples)
+      continue;
+    ordered[used++] = capture.at(x);
+  }
+
+  bool result = fit(ordered, used, capture.trigger, taus_s, newTerms, capture.trigger_us);
+  delete[] ordered;
+  return (result);
+}
+
+uint8_t NAU7802_Creep::getTermCount()
+{
+  return (terms);
+}
+
+float NAU7802_Creep::getAmplitude(uint8_t index)
+{
+  return (index < terms ? amplitude[index] : 0);
+}
+
+float NAU7802_Creep::getTau(uint8_t index)
+{
+  return (index < terms ? tau[index] : 0);
+}
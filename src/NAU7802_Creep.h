@@ -0,0 +1,66 @@
+/*
+  Load cell creep compensation for NAU7802 readings.
+
+  Under a constant load a cell's output keeps drifting toward a slightly
+  different value for minutes, and drifts back after the load is removed.
+  This is modelled as a sum of first order terms: term i relaxes toward
+  a[i] times the current load with time constant tau[i]. Because every term
+  follows the load history, both creep after loading and recovery after
+  unloading are predicted, and the prediction is subtracted from each
+  reading. Evaluation is O(terms) per sample with no allocation.
+
+  Amplitudes are fit from a captured step test (for example a capture from
+  NAU7802_EventRecorder) by linear least squares for chosen time constants.
+*/
+
+#ifndef _NAU7802_Creep_h
+#define _NAU7802_Creep_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "NAU7802_Sample.h"
+#include "NAU7802_Event.h"
+
+#define NAU7802_MAX_CREEP_TERMS 4
+
+class NAU7802_Creep
+{
+public:
+  NAU7802_Creep();
+
+  void setZeroOffset(int32_t zeroOffset);               //Reading with no load. Creep follows the load above this
+  bool setTerm(uint8_t index, float amplitude, float tau_s); //amplitude is a fraction of the load, e.g. 0.0005
+  void clearTerms();
+  void reset(); //Forget the load history
+
+  int32_t update(const NAU7802_Sample &sample);                //Feed a raw reading. Returns it with predicted creep removed
+  NAU7802_Sample compensate(const NAU7802_Sample &sample);     //Same, keeping the sample's tags
+  float getCreep();                                            //Creep currently being removed, in counts
+
+  //Fit amplitudes for the given time constants from a step test.
+  //samples[0..stepIndex) are before the load change, samples[stepIndex..count) after it settled mechanically.
+  //step_us is when the load changed; 0 takes samples[stepIndex]. Pass it when settling samples were left out.
+  //Returns false if the data can't support the fit (no step, too few samples).
+  bool fit(const NAU7802_Sample *samples, size_t count, size_t stepIndex, const float *taus_s, uint8_t terms, uint64_t step_us = 0);
+  bool fit(const NAU7802_Capture &capture, uint32_t settleSamples, const float *taus_s, uint8_t terms); //Step at the capture's trigger
+
+  uint8_t getTermCount();
+  float getAmplitude(uint8_t index);
+  float getTau(uint8_t index);
+
+private:
+  bool solve(double matrix[][NAU7802_MAX_CREEP_TERMS + 2], uint8_t n, double *solution);
+
+  uint8_t terms;
+  float amplitude[NAU7802_MAX_CREEP_TERMS];
+  float tau[NAU7802_MAX_CREEP_TERMS];
+  float state[NAU7802_MAX_CREEP_TERMS]; //Creep held by each term, in counts
+  float decay[NAU7802_MAX_CREEP_TERMS]; //1 - exp(-dt / tau) for lastDt
+  uint32_t lastDt_us;
+  uint64_t lastTime_us;
+  int32_t zero;
+  bool primed;
+};
+
+#endif
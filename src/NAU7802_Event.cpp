@@ -0,0 +1,278 @@
+/*
+  Pre-trigger event capture for NAU7802 sample streams.
+  See NAU7802_Event.h for the design.
+*/
+
+#include "NAU7802_Event.h"
+
+#include <math.h>
+
+//Sample in time order, 0 is the oldest
+NAU7802_Sample NAU7802_Capture::at(uint32_t position) const
+{
+  uint64_t record = written - count + position;
+
+  //Newest segment starting at or before the record. Segments are few, a scan is fine.
+  uint8_t x = segmentCount - 1;
+  while (x > 0 && segments[(segmentHead + x) % NAU7802_CAPTURE_SEGMENTS].first > record)
+    x--;
+  const NAU7802_Capture_Segment &segment = segments[(segmentHead + x) % NAU7802_CAPTURE_SEGMENTS];
+
+  NAU7802_Sample sample;
+  NAU7802_unpack(ring[record % size], segment.base_us, sample);
+  sample.device = segment.device;
+  sample.sequence = segment.sequence + (uint32_t)(record - segment.first);
+  return (sample);
+}
+
+NAU7802_EventRecorder::NAU7802_EventRecorder(uint32_t preSamples, uint32_t postSamples, uint8_t bufferCount)
+{
+  pre = preSamples;
+  post = postSamples < 1 ? 1 : postSamples; //The trigger sample itself counts as post
+  if (bufferCount < 2)
+    bufferCount = 2; //One hot ring plus at least one to hand out
+
+  buffers.resize(bufferCount);
+  for (uint8_t x = 0; x < bufferCount; x++)
+  {
+    buffers[x].size = pre + post;
+    buffers[x].ring = new NAU7802_Packed[pre + post];
+    reset(&buffers[x]);
+    if (x > 0)
+      spare.push_back(&buffers[x]);
+  }
+  finished.reserve(bufferCount);
+
+  hot = &buffers[0];
+  postRemaining = 0;
+
+  thresholdEnabled = false;
+  thresholdLevel = 0;
+  stepEnabled = false;
+  stepDelta = 0;
+  stepArmed = true;
+  baselineAlpha = 0.01;
+  baseline = 0;
+  rateEnabled = false;
+  rateLimit = 0;
+  havePrevious = false;
+  captures = 0;
+  dropped = 0;
+}
+
+NAU7802_EventRecorder::~NAU7802_EventRecorder()
+{
+  for (size_t x = 0; x < buffers.size(); x++)
+    delete[] buffers[x].ring;
+}
+
+void NAU7802_EventRecorder::setThreshold(bool enable, int32_t level)
+{
+  thresholdEnabled = enable;
+  thresholdLevel = level;
+}
+
+void NAU7802_EventRecorder::setStep(bool enable, int32_t delta, float alpha)
+{
+  stepEnabled = enable;
+  stepDelta = delta;
+  stepArmed = true;
+  baselineAlpha = alpha;
+}
+
+void NAU7802_EventRecorder::setRate(bool enable, float countsPerSecond)
+{
+  rateEnabled = enable;
+  rateLimit = countsPerSecond;
+}
+
+//Evaluate the enabled triggers against a new sample
+NAU7802_Trigger_Type NAU7802_EventRecorder::check(const NAU7802_Sample &sample)
+{
+  NAU7802_Trigger_Type fired = NAU7802_TRIGGER_NONE;
+
+  if (havePrevious == false)
+  {
+    baseline = sample.value;
+    return (fired);
+  }
+
+  if (thresholdEnabled)
+  {
+    bool wasAbove = previous.value >= thresholdLevel;
+    bool isAbove = sample.value >= thresholdLevel;
+    if (wasAbove != isAbove)
+      fired = NAU7802_TRIGGER_THRESHOLD;
+  }
+
+  //One step fires once; the baseline has to settle on the new level before it can fire again
+  float away = fabsf(sample.value - baseline);
+  if (stepArmed == false && away < stepDelta / 2.0f)
+    stepArmed = true;
+  if (fired == NAU7802_TRIGGER_NONE && stepEnabled && stepArmed && away > stepDelta)
+  {
+    fired = NAU7802_TRIGGER_STEP;
+    stepArmed = false;
+  }
+
+  if (fired == NAU7802_TRIGGER_NONE && rateEnabled && sample.timestamp_us > previous.timestamp_us)
+  {
+    float slope = (sample.value - previous.value) * 1E6f / (sample.timestamp_us - previous.timestamp_us);
+    if (fabsf(slope) > rateLimit)
+      fired = NAU7802_TRIGGER_RATE;
+  }
+
+  baseline += (sample.value - baseline) * baselineAlpha;
+  return (fired);
+}
+
+//Hand the hot ring to the consumer and switch to a spare one
+void NAU7802_EventRecorder::finish()
+{
+  hot->start = (hot->written - hot->count) % hot->size;
+  postRemaining = 0;
+
+  std::lock_guard<std::mutex> guard(lock);
+  finished.push_back(hot);
+  captures++;
+
+  hot = spare.back(); //finish() only runs when a spare was reserved at trigger time
+  spare.pop_back();
+  reset(hot);
+}
+
+void NAU7802_EventRecorder::reset(NAU7802_Capture *capture)
+{
+  capture->count = 0;
+  capture->written = 0;
+  capture->segmentHead = 0;
+  capture->segmentCount = 0;
+}
+
+//True if the sample continues the newest segment of the hot ring
+bool NAU7802_EventRecorder::fitsSegment(const NAU7802_Sample &sample)
+{
+  if (hot->segmentCount == 0)
+    return (false);
+  const NAU7802_Capture_Segment &last = hot->segments[(hot->segmentHead + hot->segmentCount - 1) % NAU7802_CAPTURE_SEGMENTS];
+  return (NAU7802_fitsBlock(sample, last.base_us, last.device, last.sequence + (uint32_t)(hot->written - last.first)));
+}
+
+//Drop segments whose records have all been overwritten or forgotten
+void NAU7802_EventRecorder::prune()
+{
+  uint64_t oldest = hot->written - hot->count;
+  while (hot->segmentCount > 1 && hot->segments[(hot->segmentHead + 1) % NAU7802_CAPTURE_SEGMENTS].first <= oldest)
+  {
+    hot->segmentHead = (hot->segmentHead + 1) % NAU7802_CAPTURE_SEGMENTS;
+    hot->segmentCount--;
+  }
+}
+
+//Feed the next raw sample. Constant time amortized, no allocation.
+void NAU7802_EventRecorder::add(const NAU7802_Sample &sample)
+{
+  NAU7802_Trigger_Type fired = check(sample);
+  previous = sample;
+  havePrevious = true;
+
+  //Another device, a sequence gap or a base too far back opens a segment
+  if (fitsSegment(sample) == false)
+  {
+    prune();
+    if (hot->segmentCount == NAU7802_CAPTURE_SEGMENTS)
+    {
+      if (postRemaining > 0)
+      {
+        finish(); //Out of segments part way through the post window; hand over what there is
+      }
+      else
+      {
+        //Still waiting for a trigger: give up the oldest segment's records
+        hot->segmentHead = (hot->segmentHead + 1) % NAU7802_CAPTURE_SEGMENTS;
+        hot->segmentCount--;
+        hot->count = hot->written - hot->segments[hot->segmentHead].first;
+      }
+    }
+
+    NAU7802_Capture_Segment &segment = hot->segments[(hot->segmentHead + hot->segmentCount) % NAU7802_CAPTURE_SEGMENTS];
+    segment.first = hot->written;
+    segment.base_us = sample.timestamp_us;
+    segment.sequence = sample.sequence;
+    segment.device = sample.device;
+    hot->segmentCount++;
+  }
+
+  const NAU7802_Capture_Segment &segment = hot->segments[(hot->segmentHead + hot->segmentCount - 1) % NAU7802_CAPTURE_SEGMENTS];
+  hot->ring[hot->written % hot->size] = NAU7802_pack(sample, segment.base_us);
+  hot->written++;
+  if (hot->count < hot->size)
+    hot->count++;
+
+  if (postRemaining > 0)
+  {
+    if (--postRemaining == 0)
+      finish();
+    return;
+  }
+
+  if (fired == NAU7802_TRIGGER_NONE)
+    return;
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (spare.empty())
+    {
+      dropped++; //Consumer is holding every buffer; keep the hot ring rolling
+      return;
+    }
+  }
+
+  //The ring now holds up to pre samples before the trigger; fill the rest with post samples
+  uint32_t before = hot->count - 1;
+  if (before > pre)
+    before = pre;
+  hot->trigger = before;
+  hot->type = fired;
+  hot->trigger_us = sample.timestamp_us;
+  hot->device = sample.device;
+  hot->triggerSequence = sample.sequence;
+
+  //Forget anything older than the pre window so the capture starts at the right place
+  hot->count = before + 1;
+  prune();
+  postRemaining = post - 1;
+  if (postRemaining == 0)
+    finish();
+}
+
+//Oldest finished capture, or nullptr if none. Must be handed back with releaseCapture().
+NAU7802_Capture *NAU7802_EventRecorder::takeCapture()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  if (finished.empty())
+    return (nullptr);
+  NAU7802_Capture *capture = finished.front();
+  finished.erase(finished.begin());
+  return (capture);
+}
+
+void NAU7802_EventRecorder::releaseCapture(NAU7802_Capture *capture)
+{
+  if (capture == nullptr)
+    return;
+  std::lock_guard<std::mutex> guard(lock);
+  spare.push_back(capture);
+}
+
+uint32_t NAU7802_EventRecorder::getCaptureCount()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return (captures);
+}
+
+uint32_t NAU7802_EventRecorder::getDroppedCount()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return (dropped);
+}
@@ -0,0 +1,126 @@
+/*
+  Pre-trigger event capture for NAU7802 sample streams.
+
+  The recorder continuously writes raw samples into a preallocated ring
+  sized for the pre-trigger window plus the post-trigger window. When a
+  trigger fires (level threshold, step away from a slow baseline, or rate of
+  change) the ring keeps filling only until the post-trigger window is
+  complete. The last pre-trigger samples are still in it, so the ring itself
+  becomes the capture: it is handed to the consumer as is and a spare
+  preallocated ring takes over. No samples are copied.
+
+  Rings hold 8 byte NAU7802_Packed records instead of full samples, a third
+  of the memory for the same windows. Device, sequence and base time live
+  in a short list of segments per ring: a new segment opens whenever a
+  sample can't extend the last one (another device, a gap in the sequence,
+  or 2^31 us past its base), so every sample comes back exactly as it went
+  in. A ring keeps up to NAU7802_CAPTURE_SEGMENTS segments. When a new one
+  is needed and the list is full, the oldest segment's records are given up
+  before a trigger, and the capture is finished early after one.
+
+  add() is constant time and allocation free, and must be called from one
+  thread. Completed captures may be taken and released from any thread.
+*/
+
+#ifndef _NAU7802_Event_h
+#define _NAU7802_Event_h
+
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+
+#include "NAU7802_Sample.h"
+#include "NAU7802_Packed.h"
+
+//What fired a capture
+typedef enum
+{
+  NAU7802_TRIGGER_NONE = 0,
+  NAU7802_TRIGGER_THRESHOLD, //Reading crossed a level
+  NAU7802_TRIGGER_STEP,      //Reading moved away from its slow baseline
+  NAU7802_TRIGGER_RATE,      //Reading changed faster than a slope limit
+} NAU7802_Trigger_Type;
+
+#define NAU7802_CAPTURE_SEGMENTS 16 //Device or sequence breaks one ring can hold
+
+//A run of records from one device with consecutive sequence numbers
+struct NAU7802_Capture_Segment
+{
+  uint64_t first;    //Record number of its first record, counted since the ring was last empty
+  uint64_t base_us;  //Packed timestamps are relative to this
+  uint32_t sequence; //Of its first record
+  uint16_t device;
+};
+
+//A frozen window of samples around one trigger
+struct NAU7802_Capture
+{
+  NAU7802_Packed *ring; //Owned by the recorder. Record number n lives in slot n % size
+  uint32_t size;        //Ring length, pre + post
+  uint32_t start;       //Ring slot of the oldest sample
+  uint32_t count;       //Samples held, oldest first from start
+  uint32_t trigger;     //Position of the trigger sample, counted from the oldest
+  NAU7802_Trigger_Type type;
+  uint64_t trigger_us;
+  uint16_t device;           //Of the trigger sample
+  uint32_t triggerSequence;  //Sequence number of the trigger sample
+
+  uint64_t written; //Records written, the newest is number written - 1
+  NAU7802_Capture_Segment segments[NAU7802_CAPTURE_SEGMENTS];
+  uint8_t segmentHead;  //Oldest segment
+  uint8_t segmentCount;
+
+  NAU7802_Sample at(uint32_t position) const; //Sample in time order, 0 is the oldest
+};
+
+class NAU7802_EventRecorder
+{
+public:
+  NAU7802_EventRecorder(uint32_t preSamples, uint32_t postSamples, uint8_t buffers = 4);
+  ~NAU7802_EventRecorder();
+
+  void setThreshold(bool enable, int32_t level = 0);     //Fire when the reading crosses level in either direction
+  void setStep(bool enable, int32_t delta = 0, float baselineAlpha = 0.01); //Fire when the reading is more than delta away from its moving average. Re-arms once it is back within delta / 2
+  void setRate(bool enable, float countsPerSecond = 0);  //Fire when the reading changes faster than this
+
+  void add(const NAU7802_Sample &sample); //Feed the next raw sample
+
+  NAU7802_Capture *takeCapture();             //Oldest finished capture, or nullptr. Hand it back with releaseCapture()
+  void releaseCapture(NAU7802_Capture *capture);
+  uint32_t getCaptureCount();                 //Captures finished since construction
+  uint32_t getDroppedCount();                 //Triggers ignored because every spare buffer was in use
+
+private:
+  NAU7802_Trigger_Type check(const NAU7802_Sample &sample);
+  void finish();
+  void reset(NAU7802_Capture *capture);
+  bool fitsSegment(const NAU7802_Sample &sample);
+  void prune();
+
+  uint32_t pre;
+  uint32_t post;
+  std::vector<NAU7802_Capture> buffers;
+
+  NAU7802_Capture *hot;       //Ring currently being written
+  uint32_t postRemaining;     //Samples still to record after a trigger, 0 when armed
+
+  bool thresholdEnabled;
+  int32_t thresholdLevel;
+  bool stepEnabled;
+  int32_t stepDelta;
+  bool stepArmed; //Cleared when the step trigger fires until the baseline catches up
+  float baselineAlpha;
+  float baseline;
+  bool rateEnabled;
+  float rateLimit;
+  bool havePrevious;
+  NAU7802_Sample previous;
+
+  std::mutex lock; //Guards the free and finished lists
+  std::vector<NAU7802_Capture *> spare;
+  std::vector<NAU7802_Capture *> finished;
+  uint32_t captures;
+  uint32_t dropped;
+};
+
+#endif
@@ -0,0 +1,295 @@
+/*
+  Structure of arrays container for hundreds of NAU7802s.
+  See NAU7802_Fleet.h for the design.
+*/
+
+#include "NAU7802_Fleet.h"
+
+#include <algorithm>
+
+NAU7802_Fleet::NAU7802_Fleet(uint32_t capacity)
+{
+  if (capacity > NAU7802_FLEET_MAX_CELLS)
+    capacity = NAU7802_FLEET_MAX_CELLS; //Error check
+  this->capacity = capacity;
+  ioctls = 0;
+  sorted = true;
+
+  zeroOffset.reserve(capacity);
+  inverseFactor.reserve(capacity);
+  value.reserve(capacity);
+  timestamp.reserve(capacity);
+  sequence.reserve(capacity);
+  channel.reserve(capacity);
+  flags.reserve(capacity);
+  fresh.reserve(capacity);
+  pending.reserve(capacity);
+  cells.reserve(capacity);
+  order.reserve(capacity);
+}
+
+NAU7802_Fleet::~NAU7802_Fleet()
+{
+  for (size_t x = 0; x < cells.size(); x++)
+    delete cells[x];
+}
+
+int NAU7802_Fleet::add(uint8_t i2c_bus, uint8_t i2c_addr)
+{
+  if (cells.size() >= capacity)
+    return (-1);
+  return (push(new NAU7802(i2c_bus, i2c_addr)));
+}
+
+int NAU7802_Fleet::add(uint8_t i2c_bus, NAU7802_Mux &mux, uint8_t muxChannel, uint8_t i2c_addr)
+{
+  if (cells.size() >= capacity)
+    return (-1);
+  return (push(new NAU7802(i2c_bus, mux, muxChannel, i2c_addr)));
+}
+
+//Grow every array by one cell. Never reallocates, the constructor reserved capacity.
+int NAU7802_Fleet::push(NAU7802 *device)
+{
+  uint32_t cell = cells.size();
+  device->setDeviceTag(cell);
+  cells.push_back(device);
+
+  zeroOffset.push_back(0);
+  inverseFactor.push_back(1.0);
+  value.push_back(0);
+  timestamp.push_back(0);
+  sequence.push_back(0);
+  channel.push_back(NAU7802_CHANNEL_1);
+  flags.push_back(0);
+  fresh.push_back(0);
+  pending.push_back(0);
+  order.push_back(cell);
+  sorted = false;
+  return (cell);
+}
+
+bool NAU7802_Fleet::begin(bool initialize)
+{
+  bool result = true;
+  for (size_t x = 0; x < cells.size(); x++)
+  {
+    result &= cells[x]->begin(initialize);
+    refreshCalibration(x);
+  }
+  return (result);
+}
+
+uint32_t NAU7802_Fleet::getCount()
+{
+  return (cells.size());
+}
+
+uint32_t NAU7802_Fleet::getCapacity()
+{
+  return (capacity);
+}
+
+NAU7802 *NAU7802_Fleet::getDevice(uint32_t cell)
+{
+  if (cell >= cells.size())
+    return (nullptr);
+  return (cells[cell]);
+}
+
+void NAU7802_Fleet::setZeroOffset(uint32_t cell, int32_t offset)
+{
+  if (cell >= cells.size())
+    return;
+  cells[cell]->setZeroOffset(offset);
+  zeroOffset[cell] = offset;
+}
+
+void NAU7802_Fleet::setCalibrationFactor(uint32_t cell, float factor)
+{
+  if (cell >= cells.size())
+    return;
+  cells[cell]->setCalibrationFactor(factor);
+  inverseFactor[cell] = 1.0 / factor;
+}
+
+void NAU7802_Fleet::refreshCalibration(uint32_t cell)
+{
+  if (cell >= cells.size())
+    return;
+  zeroOffset[cell] = cells[cell]->getZeroOffset();
+  inverseFactor[cell] = 1.0 / cells[cell]->getCalibrationFactor();
+}
+
+//Cells on the same adapter go together so each readAll() serves one adapter
+void NAU7802_Fleet::sortByAdapter()
+{
+  std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+    return cells[a]->getBus() < cells[b]->getBus();
+  });
+  sorted = true;
+}
+
+//Read every cell in as few I2C_RDWR calls as readAll() can manage
+uint32_t NAU7802_Fleet::poll()
+{
+  if (sorted == false)
+    sortByAdapter();
+
+  std::fill(fresh.begin(), fresh.end(), 0);
+
+  uint32_t readings = 0;
+  size_t next = 0;
+  while (next < order.size())
+  {
+    //Up to a frame's worth of cells from one adapter
+    uint8_t bus = cells[order[next]]->getBus();
+    uint8_t count = 0;
+    while (next + count < order.size() && count < NAU7802_FRAME_DEVICES && cells[order[next + count]]->getBus() == bus)
+    {
+      batch[count] = cells[order[next + count]];
+      count++;
+    }
+
+    readings += NAU7802::readAll(batch, count, frame);
+    ioctls += frame.ioctls;
+    for (uint8_t x = 0; x < count; x++)
+    {
+      if (frame.valid[x] == false)
+        continue;
+      uint32_t cell = order[next + x];
+      value[cell] = frame.samples[x].value;
+      timestamp[cell] = frame.samples[x].timestamp_us;
+      sequence[cell] = frame.samples[x].sequence;
+      channel[cell] = frame.samples[x].channel;
+      flags[cell] = frame.samples[x].flags;
+      fresh[cell] = 1;
+    }
+    next += count;
+  }
+  return (readings);
+}
+
+const int32_t *NAU7802_Fleet::getValues()
+{
+  return (value.data());
+}
+
+const uint64_t *NAU7802_Fleet::getTimestamps()
+{
+  return (timestamp.data());
+}
+
+const uint32_t *NAU7802_Fleet::getSequences()
+{
+  return (sequence.data());
+}
+
+const uint8_t *NAU7802_Fleet::getFlags()
+{
+  return (flags.data());
+}
+
+const uint8_t *NAU7802_Fleet::getFresh()
+{
+  return (fresh.data());
+}
+
+//Keep polling and append every new reading to out
+//The timeout is checked after every poll, busy or not. Readings a poll brought in beyond
+//maxSamples stay pending and lead the next call, before another poll can overwrite them.
+//Sleeps up to 1ms between polls that found nothing. Returns the number of samples written.
+size_t NAU7802_Fleet::collect(NAU7802_Sample *out, size_t maxSamples, uint32_t timeout_ms)
+{
+  size_t count = takePending(out, maxSamples);
+  uint64_t deadline = NAU7802_timestamp() + (uint64_t)timeout_ms * 1000;
+  while (count < maxSamples)
+  {
+    uint32_t readings = poll();
+    if (readings > 0)
+    {
+      for (size_t cell = 0; cell < cells.size(); cell++)
+        pending[cell] |= fresh[cell];
+      count += takePending(&out[count], maxSamples - count);
+    }
+
+    uint64_t now = NAU7802_timestamp();
+    if (count >= maxSamples || now >= deadline)
+      break;
+    if (readings == 0)
+      usleep(std::min<uint64_t>(1000, deadline - now));
+  }
+  return (count);
+}
+
+//Hand out pending readings in cell order, up to maxSamples
+size_t NAU7802_Fleet::takePending(NAU7802_Sample *out, size_t maxSamples)
+{
+  size_t count = 0;
+  for (size_t cell = 0; cell < cells.size() && count < maxSamples; cell++)
+  {
+    if (pending[cell] == 0)
+      continue;
+    pending[cell] = 0;
+    NAU7802_Sample &sample = out[count++];
+    sample.timestamp_us = timestamp[cell];
+    sample.value = value[cell];
+    sample.device = cell;
+    sample.channel = channel[cell];
+    sample.flags = flags[cell];
+    sample.sequence = sequence[cell];
+  }
+  return (count);
+}
+
+void NAU7802_Fleet::convert(float *weights)
+{
+  convert(value.data(), zeroOffset.data(), inverseFactor.data(), weights, cells.size());
+}
+
+//Weights of cells first to first + count - 1
+void NAU7802_Fleet::convert(uint32_t first, uint32_t count, float *weights)
+{
+  if (first >= cells.size())
+    return;
+  if (count > cells.size() - first)
+    count = cells.size() - first;
+  convert(&value[first], &zeroOffset[first], &inverseFactor[first], weights, count);
+}
+
+//Samples from collect() carry their cell in the device field
+void NAU7802_Fleet::convert(const NAU7802_Sample *samples, float *weights, size_t count)
+{
+  for (size_t x = 0; x < count; x++)
+  {
+    uint16_t cell = samples[x].device;
+    if (cell >= cells.size())
+      weights[x] = 0;
+    else
+      weights[x] = (float)(samples[x].value - zeroOffset[cell]) * inverseFactor[cell];
+  }
+}
+
+//(reading - zero offset) / calibration factor over whole arrays. No branches, so it vectorizes.
+//Negative weights are kept; clamp afterwards if the application needs it.
+void NAU7802_Fleet::convert(const int32_t *__restrict values, const int32_t *__restrict offsets,
+                            const float *__restrict inverseFactors, float *__restrict weights, uint32_t count)
+{
+  for (uint32_t x = 0; x < count; x++)
+    weights[x] = (float)(values[x] - offsets[x]) * inverseFactors[x];
+}
+
+const int32_t *NAU7802_Fleet::getZeroOffsets()
+{
+  return (zeroOffset.data());
+}
+
+const float *NAU7802_Fleet::getInverseFactors()
+{
+  return (inverseFactor.data());
+}
+
+uint32_t NAU7802_Fleet::getIoctlCount()
+{
+  return (ioctls);
+}
@@ -0,0 +1,89 @@
+/*
+  Structure of arrays container for hundreds of NAU7802s.
+
+  Each cell keeps its NAU7802 object for configuration and calibration (the
+  cold path), while the values touched on every sample live in contiguous
+  arrays: zero offset, inverse calibration factor and the last reading.
+  poll() fetches every cell with batched readAll() transfers, one group per
+  adapter, and convert() turns all readings into weights in one straight
+  loop the compiler vectorizes.
+
+  Storage is allocated once for the capacity given to the constructor;
+  add() never reallocates, so array pointers handed out stay valid. Cells on
+  one adapter share its file descriptor.
+
+  Not thread safe. Drive a fleet from one thread, or one fleet per adapter.
+*/
+
+#ifndef _NAU7802_Fleet_h
+#define _NAU7802_Fleet_h
+
+#include <stdint.h>
+#include <vector>
+
+#include "NAU7802.h"
+
+#define NAU7802_FLEET_MAX_CELLS 65535 //Cell indexes travel in the 16-bit sample device field
+
+class NAU7802_Fleet
+{
+public:
+  NAU7802_Fleet(uint32_t capacity); //At most NAU7802_FLEET_MAX_CELLS
+  ~NAU7802_Fleet();
+
+  int add(uint8_t i2c_bus, uint8_t i2c_addr = 0x2A);                               //Returns the cell index, or -1 when full
+  int add(uint8_t i2c_bus, NAU7802_Mux &mux, uint8_t muxChannel, uint8_t i2c_addr = 0x2A); //Cell behind a mux channel
+  bool begin(bool initialize = true);                                              //begin() every cell. False if any failed
+  uint32_t getCount();
+  uint32_t getCapacity();
+  NAU7802 *getDevice(uint32_t cell); //Cold path: gain, rate, calibration. Call refreshCalibration() after changing offset or factor there
+
+  void setZeroOffset(uint32_t cell, int32_t offset);
+  void setCalibrationFactor(uint32_t cell, float factor);
+  void refreshCalibration(uint32_t cell); //Copy zero offset and factor from the cell's NAU7802
+
+  uint32_t poll();                  //Read every cell that has a conversion ready. Returns how many did
+  const int32_t *getValues();       //Last reading per cell
+  const uint64_t *getTimestamps();  //Steady clock microseconds of each last reading, 0 if none yet
+  const uint32_t *getSequences();   //Read count of each cell when its last reading was taken
+  const uint8_t *getFlags();        //NAU7802_FLAG_ bits of each last reading
+  const uint8_t *getFresh();        //1 if the last poll() got a new reading for the cell
+  size_t collect(NAU7802_Sample *out, size_t maxSamples, uint32_t timeout_ms); //Poll until maxSamples new readings or the timeout. Readings that didn't fit come first next call. Sample device is the cell index
+
+  void convert(float *weights);                    //Weight of every cell's last reading
+  void convert(uint32_t first, uint32_t count, float *weights);
+  void convert(const NAU7802_Sample *samples, float *weights, size_t count); //Weights of collected samples, using each sample's cell
+  static void convert(const int32_t *values, const int32_t *offsets, const float *inverseFactors, float *weights, uint32_t count);
+
+  const int32_t *getZeroOffsets();
+  const float *getInverseFactors();
+  uint32_t getIoctlCount(); //I2C_RDWR calls made by poll() so far
+
+private:
+  int push(NAU7802 *device);
+  size_t takePending(NAU7802_Sample *out, size_t maxSamples);
+  void sortByAdapter();
+
+  uint32_t capacity;
+  uint32_t ioctls;
+
+  //Hot, one entry per cell
+  std::vector<int32_t> zeroOffset;
+  std::vector<float> inverseFactor;
+  std::vector<int32_t> value;
+  std::vector<uint64_t> timestamp;
+  std::vector<uint32_t> sequence;
+  std::vector<uint8_t> channel;
+  std::vector<uint8_t> flags;
+  std::vector<uint8_t> fresh;
+  std::vector<uint8_t> pending; //Fresh reading collect() had no room for yet
+
+  //Cold
+  std::vector<NAU7802 *> cells;
+  std::vector<uint32_t> order; //Cells grouped by adapter for poll()
+  bool sorted;
+  NAU7802 *batch[NAU7802_FRAME_DEVICES];
+  NAU7802_Frame frame;
+};
+
+#endif
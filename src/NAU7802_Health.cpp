@@ -0,0 +1,234 @@
+/*
+  Sensor health alarms for one NAU7802 channel.
+  See NAU7802_Health.h for the checks.
+*/
+
+#include "NAU7802_Health.h"
+
+#include <math.h>
+
+NAU7802_Health::NAU7802_Health(uint32_t blockSamples) : blocks(blockSamples)
+{
+  for (uint8_t x = 0; x < NAU7802_ALARM_TYPES; x++)
+    active[x] = false;
+  device = 0;
+
+  zero = 0;
+  unloadedMean = 0;
+  driftRaise = driftClear = zeroBand = 0;
+  driftEnabled = false;
+  noiseRaise = noiseClear = 0;
+  noiseEnabled = false;
+  noiseCount = noiseNext = 0;
+
+  //Rails and stuck codes are always worth knowing about
+  saturationRaise = 3;
+  saturationClear = 10;
+  railRun = offRailRun = 0;
+  stuckRaise = 100;
+  stuckClear = 10;
+  sameRun = changingRun = 0;
+  previous = 0;
+  havePrevious = false;
+
+  calRaise = 2;
+  calClear = 0;
+  calHistory = 0;
+
+  eventHead = eventCount = 0;
+  lostEvents = 0;
+}
+
+//Raise when an unloaded block's mean is more than raiseCounts from zeroOffset, clear below clearCounts
+void NAU7802_Health::setZeroDrift(int32_t zeroOffset, float raiseCounts, float clearCounts, float band)
+{
+  zero = zeroOffset;
+  unloadedMean = zeroOffset;
+  driftRaise = raiseCounts;
+  driftClear = clearCounts;
+  zeroBand = band;
+  driftEnabled = true;
+}
+
+//Raise when the quietest recent block's RMS noise exceeds raiseRms, clear below clearRms
+void NAU7802_Health::setNoise(float raiseRms, float clearRms)
+{
+  noiseRaise = raiseRms;
+  noiseClear = clearRms;
+  noiseEnabled = true;
+}
+
+void NAU7802_Health::setSaturation(uint32_t raiseRun, uint32_t clearRun)
+{
+  saturationRaise = raiseRun;
+  saturationClear = clearRun;
+}
+
+void NAU7802_Health::setStuck(uint32_t raiseRun, uint32_t clearRun)
+{
+  stuckRaise = raiseRun;
+  stuckClear = clearRun;
+}
+
+//Raise when at least raiseFailures of the last 8 calibrations failed, clear at clearFailures or fewer
+void NAU7802_Health::setCalibration(uint8_t raiseFailures, uint8_t clearFailures)
+{
+  calRaise = raiseFailures;
+  calClear = clearFailures;
+}
+
+void NAU7802_Health::setCallback(NAU7802_Health_Callback newCallback)
+{
+  callback = newCallback;
+}
+
+//Record a state change and queue the event. The oldest event is overwritten if nobody drains them.
+void NAU7802_Health::change(NAU7802_Alarm_Type type, bool raise, uint64_t timestamp_us, double value)
+{
+  if (active[type] == raise)
+    return;
+  active[type] = raise;
+
+  NAU7802_Health_Event event;
+  event.timestamp_us = timestamp_us;
+  event.type = type;
+  event.raised = raise;
+  event.device = device;
+  event.value = value;
+
+  if (eventCount == NAU7802_HEALTH_EVENTS)
+  {
+    eventHead = (eventHead + 1) % NAU7802_HEALTH_EVENTS;
+    eventCount--;
+    lostEvents++;
+  }
+  events[(eventHead + eventCount) % NAU7802_HEALTH_EVENTS] = event;
+  eventCount++;
+
+  if (callback)
+    callback(event);
+}
+
+//Judge drift and noise once per completed block
+void NAU7802_Health::checkBlock(const NAU7802_Welford &block, uint64_t timestamp_us)
+{
+  double rms = sqrt(block.variance());
+
+  if (noiseEnabled)
+  {
+    noiseHistory[noiseNext] = rms;
+    noiseNext = (noiseNext + 1) % NAU7802_NOISE_BLOCKS;
+    if (noiseCount < NAU7802_NOISE_BLOCKS)
+      noiseCount++;
+
+    //Load changes make single blocks noisy; the quietest recent block is the floor
+    float floor = noiseHistory[0];
+    for (uint8_t x = 1; x < noiseCount; x++)
+    {
+      if (noiseHistory[x] < floor)
+        floor = noiseHistory[x];
+    }
+
+    if (noiseCount == NAU7802_NOISE_BLOCKS && floor > noiseRaise)
+      change(NAU7802_ALARM_NOISE, true, timestamp_us, floor);
+    else if (floor < noiseClear)
+      change(NAU7802_ALARM_NOISE, false, timestamp_us, floor);
+  }
+
+  if (driftEnabled)
+  {
+    //Only a still, unloaded block says anything about the zero. Unloaded is judged against the
+    //last unloaded block rather than the reference, so slow drift is followed past zeroBand.
+    double drift = block.mean - zero;
+    bool unloaded = fabs(block.mean - unloadedMean) <= zeroBand;
+    bool still = noiseEnabled == false || rms <= noiseRaise;
+    if (unloaded && still)
+    {
+      unloadedMean = block.mean;
+      if (fabs(drift) > driftRaise)
+        change(NAU7802_ALARM_ZERO_DRIFT, true, timestamp_us, drift);
+      else if (fabs(drift) < driftClear)
+        change(NAU7802_ALARM_ZERO_DRIFT, false, timestamp_us, drift);
+    }
+  }
+}
+
+//Feed one raw sample. Constant time, no allocation.
+void NAU7802_Health::add(const NAU7802_Sample &sample)
+{
+  device = sample.device;
+  int32_t value = sample.value;
+
+  //Saturation
+  if (NAU7802_saturation(value) || (sample.flags & NAU7802_FLAG_SATURATED))
+  {
+    offRailRun = 0;
+    if (++railRun >= saturationRaise)
+      change(NAU7802_ALARM_SATURATION, true, sample.timestamp_us, railRun);
+  }
+  else
+  {
+    railRun = 0;
+    if (++offRailRun >= saturationClear)
+      change(NAU7802_ALARM_SATURATION, false, sample.timestamp_us, offRailRun);
+  }
+
+  //Stuck. A healthy 24-bit conversion almost never repeats; pinned rails are reported as saturation instead.
+  if (havePrevious && value == previous && railRun == 0)
+  {
+    changingRun = 0;
+    if (++sameRun >= stuckRaise)
+      change(NAU7802_ALARM_STUCK, true, sample.timestamp_us, sameRun);
+  }
+  else
+  {
+    sameRun = 0;
+    if (++changingRun >= stuckClear)
+      change(NAU7802_ALARM_STUCK, false, sample.timestamp_us, changingRun);
+  }
+  previous = value;
+  havePrevious = true;
+
+  if (blocks.add(sample))
+    checkBlock(blocks.getLast(), sample.timestamp_us);
+}
+
+//Feed the outcome of an AFE calibration
+void NAU7802_Health::addCalibrationResult(NAU7802_Cal_Status status, uint64_t timestamp_us)
+{
+  if (status == NAU7802_CAL_IN_PROGRESS)
+    return;
+  if (timestamp_us == 0)
+    timestamp_us = NAU7802_timestamp();
+
+  calHistory = (calHistory << 1) | (status == NAU7802_CAL_FAILURE ? 1 : 0);
+
+  uint8_t failures = __builtin_popcount(calHistory);
+  if (failures >= calRaise)
+    change(NAU7802_ALARM_CAL_ERROR, true, timestamp_us, failures);
+  else if (failures <= calClear)
+    change(NAU7802_ALARM_CAL_ERROR, false, timestamp_us, failures);
+}
+
+bool NAU7802_Health::isActive(NAU7802_Alarm_Type type)
+{
+  if (type >= NAU7802_ALARM_TYPES)
+    return (false);
+  return (active[type]);
+}
+
+//Oldest undrained event. Returns false when there are none.
+bool NAU7802_Health::getEvent(NAU7802_Health_Event &event)
+{
+  if (eventCount == 0)
+    return (false);
+  event = events[eventHead];
+  eventHead = (eventHead + 1) % NAU7802_HEALTH_EVENTS;
+  eventCount--;
+  return (true);
+}
+
+uint32_t NAU7802_Health::getLostEvents()
+{
+  return (lostEvents);
+}
@@ -0,0 +1,107 @@
+/*
+  Sensor health alarms for one NAU7802 channel.
+
+  Everything is judged incrementally from the raw stream, so the cost per
+  sample is constant no matter how many cells are watched:
+
+    - Zero drift: mean of quiet unloaded blocks wanders from the reference zero.
+      A block counts as unloaded near the last unloaded block, so a zero that
+      creeps off slowly is followed and still raises past zeroBand
+    - Noise floor: the quietest recent block is noisier than a limit
+    - Saturation: readings pinned at the 24-bit rails
+    - Stuck: the same code repeated for too long
+    - Calibration: CAL_ERROR returned by too many recent AFE calibrations
+
+  Every alarm has separate raise and clear conditions so a value hovering at
+  a limit doesn't chatter. Raising and clearing are reported as events,
+  queued in a preallocated ring and optionally passed to a callback.
+*/
+
+#ifndef _NAU7802_Health_h
+#define _NAU7802_Health_h
+
+#include <stdint.h>
+#include <functional>
+
+#include "NAU7802.h"
+#include "NAU7802_Stats.h"
+
+#define NAU7802_NOISE_BLOCKS 8        //Recent blocks considered for the noise floor
+#define NAU7802_HEALTH_EVENTS 32      //Undrained events kept
+
+//Health checks
+typedef enum
+{
+  NAU7802_ALARM_ZERO_DRIFT = 0,
+  NAU7802_ALARM_NOISE,
+  NAU7802_ALARM_SATURATION,
+  NAU7802_ALARM_STUCK,
+  NAU7802_ALARM_CAL_ERROR,
+  NAU7802_ALARM_TYPES,
+} NAU7802_Alarm_Type;
+
+//An alarm being raised or cleared
+struct NAU7802_Health_Event
+{
+  uint64_t timestamp_us;
+  NAU7802_Alarm_Type type;
+  bool raised;   //false when the alarm cleared
+  uint16_t device;
+  double value;  //Measurement that triggered the change: drift or noise in counts, run length, failure count
+};
+
+typedef std::function<void(const NAU7802_Health_Event &)> NAU7802_Health_Callback;
+
+class NAU7802_Health
+{
+public:
+  NAU7802_Health(uint32_t blockSamples = 80); //Drift and noise are judged per block of this many samples
+
+  void setZeroDrift(int32_t zeroOffset, float raiseCounts, float clearCounts, float zeroBand); //Only blocks within zeroBand of the last unloaded one count as unloaded
+  void setNoise(float raiseRms, float clearRms);
+  void setSaturation(uint32_t raiseRun, uint32_t clearRun); //Consecutive samples at / off the rails
+  void setStuck(uint32_t raiseRun, uint32_t clearRun);      //Consecutive identical / changing samples
+  void setCalibration(uint8_t raiseFailures, uint8_t clearFailures); //Failures among the last 8 calibrations
+  void setCallback(NAU7802_Health_Callback callback);
+
+  void add(const NAU7802_Sample &sample);                 //Constant time, no allocation
+  void addCalibrationResult(NAU7802_Cal_Status status, uint64_t timestamp_us = 0); //Feed calAFEStatus() results
+
+  bool isActive(NAU7802_Alarm_Type type);
+  bool getEvent(NAU7802_Health_Event &event); //Oldest undrained event
+  uint32_t getLostEvents();                   //Events overwritten before they were drained
+
+private:
+  void change(NAU7802_Alarm_Type type, bool raise, uint64_t timestamp_us, double value);
+  void checkBlock(const NAU7802_Welford &block, uint64_t timestamp_us);
+
+  bool active[NAU7802_ALARM_TYPES];
+  uint16_t device;
+
+  NAU7802_TumblingStats blocks;
+  int32_t zero;
+  double unloadedMean; //Mean of the last unloaded block, starts at zero
+  float driftRaise, driftClear, zeroBand;
+  bool driftEnabled;
+  float noiseRaise, noiseClear;
+  bool noiseEnabled;
+  float noiseHistory[NAU7802_NOISE_BLOCKS];
+  uint8_t noiseCount, noiseNext;
+
+  uint32_t saturationRaise, saturationClear;
+  uint32_t railRun, offRailRun;
+  uint32_t stuckRaise, stuckClear;
+  uint32_t sameRun, changingRun;
+  int32_t previous;
+  bool havePrevious;
+
+  uint8_t calRaise, calClear;
+  uint8_t calHistory; //One bit per recent calibration, 1 = failed
+
+  NAU7802_Health_Callback callback;
+  NAU7802_Health_Event events[NAU7802_HEALTH_EVENTS];
+  uint8_t eventHead, eventCount;
+  uint32_t lostEvents;
+};
+
+#endif
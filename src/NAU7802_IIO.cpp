@@ -0,0 +1,381 @@
+/*
+  Linux IIO transport for the NAU7802.
+  See NAU7802_IIO.h for the design.
+*/
+
+#include "NAU7802_IIO.h"
+
+#include <dirent.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+//Output data rate for each CRS value, as the driver's sampling_frequency expects it
+static const char *iioRates[8] = {"10", "20", "40", "80", nullptr, nullptr, nullptr, "320"};
+
+NAU7802_IIO::NAU7802_IIO(uint8_t iio_device, const char *sysfsRoot, const char *devRoot)
+{
+  snprintf(this->sysfsRoot, sizeof(this->sysfsRoot), "%s", sysfsRoot);
+  snprintf(sysfsPath, sizeof(sysfsPath), "%s/iio:device%u", sysfsRoot, iio_device);
+  iioDevice = iio_device;
+  snprintf(devPath, sizeof(devPath), "%s/iio:device%u", devRoot, iio_device);
+  fd = -1;
+  bufferCapable = false;
+
+  bigEndian = false;
+  isSigned = true;
+  realBits = 24;
+  storageBytes = 4;
+  shift = 0;
+
+  channel = NAU7802_CHANNEL_1;
+  sampleRate = NAU7802_SPS_10;
+
+  readBuffer = nullptr;
+  readBufferSize = 0;
+}
+
+NAU7802_IIO::~NAU7802_IIO()
+{
+  stopBuffer();
+  delete[] readBuffer;
+}
+
+//Read a sysfs attribute below the device directory, without the trailing newline
+bool NAU7802_IIO::readAttribute(const char *attribute, char *value, size_t length)
+{
+  char path[192];
+  snprintf(path, sizeof(path), "%s/%s", sysfsPath, attribute);
+
+  int file = open(path, O_RDONLY);
+  if (file < 0)
+    return (false);
+  ssize_t count = read(file, value, length - 1);
+  close(file);
+  if (count < 0)
+    return (false);
+
+  value[count] = 0;
+  while (count > 0 && (value[count - 1] == '\n' || value[count - 1] == ' '))
+    value[--count] = 0;
+  return (true);
+}
+
+bool NAU7802_IIO::writeAttribute(const char *attribute, const char *value)
+{
+  char path[192];
+  snprintf(path, sizeof(path), "%s/%s", sysfsPath, attribute);
+
+  int file = open(path, O_WRONLY | O_TRUNC);
+  if (file < 0)
+    return (false);
+  ssize_t count = write(file, value, strlen(value));
+  close(file);
+  if (count < 0)
+  {
+    int error = errno;
+    printf("Error while writing IIO attribute %s, Error: %s\n", attribute, strerror(error));
+    errno = error; //Left for the caller to report
+    return (false);
+  }
+  return (true);
+}
+
+//Find the trigger the driver registered for this device, "<name>-dev<N>" by IIO convention
+//Falls back to any trigger named after the device. Returns false if there is none.
+bool NAU7802_IIO::findTrigger(char *trigger, size_t length)
+{
+  char name[32];
+  if (readAttribute("name", name, sizeof(name)) == false)
+    return (false);
+  char own[48];
+  snprintf(own, sizeof(own), "%s-dev%u", name, iioDevice);
+
+  DIR *directory = opendir(sysfsRoot);
+  if (directory == nullptr)
+    return (false);
+
+  bool found = false;
+  for (struct dirent *entry = readdir(directory); entry != nullptr; entry = readdir(directory))
+  {
+    if (strncmp(entry->d_name, "trigger", 7) != 0)
+      continue;
+
+    char path[192];
+    char candidate[48];
+    snprintf(path, sizeof(path), "%s/%s/name", sysfsRoot, entry->d_name);
+    int file = open(path, O_RDONLY);
+    if (file < 0)
+      continue;
+    ssize_t count = read(file, candidate, sizeof(candidate) - 1);
+    close(file);
+    if (count <= 0)
+      continue;
+    candidate[count] = 0;
+    candidate[strcspn(candidate, "\n")] = 0;
+
+    if (strcmp(candidate, own) == 0 || (found == false && strncmp(candidate, name, strlen(name)) == 0))
+    {
+      snprintf(trigger, length, "%s", candidate);
+      found = true;
+      if (strcmp(candidate, own) == 0)
+        break;
+    }
+  }
+  closedir(directory);
+  return (found);
+}
+
+//Check the device and whether the driver can buffer
+bool NAU7802_IIO::begin()
+{
+  if (isConnected() == false)
+    return (false);
+
+  bufferCapable = parseScanType();
+  return (true);
+}
+
+bool NAU7802_IIO::isConnected()
+{
+  char name[32];
+  if (readAttribute("name", name, sizeof(name)) == false)
+  {
+    printf("IIO device not found at %s\n", sysfsPath);
+    return (false);
+  }
+  if (strstr(name, "nau7802") == nullptr)
+  {
+    printf("IIO device %s is a %s, not a nau7802\n", sysfsPath, name);
+    return (false);
+  }
+  return (true);
+}
+
+//Parse scan_elements/in_voltageN_type, e.g. "be:s24/32>>0"
+//Returns false if the driver exposes no buffer for this channel
+bool NAU7802_IIO::parseScanType()
+{
+  char attribute[48];
+  char type[32];
+  snprintf(attribute, sizeof(attribute), "scan_elements/in_voltage%u_type", channel);
+  if (readAttribute(attribute, type, sizeof(type)) == false)
+    return (false);
+
+  char endian[3] = {0};
+  char sign = 's';
+  unsigned bits = 0, storage = 0, shiftBits = 0;
+  if (sscanf(type, "%2c:%c%u/%u>>%u", endian, &sign, &bits, &storage, &shiftBits) < 4)
+    return (false);
+  //decode() shifts a storage sized word, so the field has to fit inside it
+  if (storage == 0 || storage % 8 || storage > 64 || bits == 0 || bits > 32 || bits + shiftBits > storage)
+    return (false);
+
+  bigEndian = (endian[0] == 'b');
+  isSigned = (sign == 's');
+  realBits = bits;
+  storageBytes = storage / 8;
+  shift = shiftBits;
+  return (true);
+}
+
+//Turn one scan element into a sign extended reading
+int32_t NAU7802_IIO::decode(const uint8_t *raw)
+{
+  uint64_t word = 0;
+  for (uint8_t x = 0; x < storageBytes; x++)
+  {
+    uint8_t byte = bigEndian ? raw[x] : raw[storageBytes - 1 - x];
+    word = (word << 8) | byte;
+  }
+  if (shift >= 64)
+    return (0); //parseScanType() never allows this
+  word >>= shift;
+  word &= (1ULL << realBits) - 1;
+
+  if (isSigned && (word & (1ULL << (realBits - 1))))
+    return ((int32_t)(word - (1ULL << realBits)));
+  return ((int32_t)word);
+}
+
+//Select a gain by picking the matching entry of the driver's scale list (largest scale is x1)
+bool NAU7802_IIO::setGain(uint8_t gainValue)
+{
+  if (gainValue > 0b111)
+    gainValue = 0b111; //Error check
+
+  char available[256];
+  if (readAttribute("in_voltage_scale_available", available, sizeof(available)) == false)
+    return (false);
+
+  char *tokens[16];
+  uint8_t count = 0;
+  for (char *token = strtok(available, " "); token != nullptr && count < 16; token = strtok(nullptr, " "))
+    tokens[count++] = token;
+  if (count <= gainValue)
+    return (false);
+
+  std::sort(tokens, tokens + count, [](const char *a, const char *b) { return atof(a) > atof(b); });
+  return (writeAttribute("in_voltage_scale", tokens[gainValue]));
+}
+
+bool NAU7802_IIO::setSampleRate(uint8_t rate)
+{
+  if (rate > 0b111)
+    rate = 0b111; //Error check
+  if (iioRates[rate] == nullptr)
+    return (false);
+
+  //Newer kernels share it by channel type, older ones across the device
+  if (writeAttribute("in_voltage_sampling_frequency", iioRates[rate]) == false &&
+      writeAttribute("sampling_frequency", iioRates[rate]) == false)
+    return (false);
+
+  sampleRate = rate;
+  return (true);
+}
+
+//Select between 1 and 2. A running buffer is stopped since its scan mask changes.
+bool NAU7802_IIO::setChannel(uint8_t channelNumber)
+{
+  stopBuffer();
+  channel = (channelNumber == NAU7802_CHANNEL_1) ? NAU7802_CHANNEL_1 : NAU7802_CHANNEL_2;
+  if (bufferCapable)
+    bufferCapable = parseScanType();
+  return (true);
+}
+
+//Enable kernel buffering of conversions for the selected channel
+//A triggered buffer refuses to enable without a trigger, so one is attached first: the one named,
+//else the device's own. Drivers that fill the buffer themselves have no trigger/ directory.
+bool NAU7802_IIO::startBuffer(uint32_t length, const char *trigger)
+{
+  if (bufferCapable == false)
+    return (false);
+  if (fd >= 0)
+    return (true); //Already streaming
+
+  char attribute[48];
+  char value[16];
+  writeAttribute("buffer/enable", "0"); //Scan mask can only change while disabled
+
+  for (uint8_t x = 0; x < 2; x++)
+  {
+    snprintf(attribute, sizeof(attribute), "scan_elements/in_voltage%u_en", x);
+    writeAttribute(attribute, x == channel ? "1" : "0");
+  }
+  writeAttribute("scan_elements/in_timestamp_en", "0"); //Optional; host timestamps are used instead
+
+  char current[48] = {0};
+  if (readAttribute("trigger/current_trigger", current, sizeof(current)))
+  {
+    if (trigger != nullptr)
+      snprintf(current, sizeof(current), "%s", trigger);
+    else if (current[0] == 0 && findTrigger(current, sizeof(current)) == false)
+    {
+      printf("IIO buffer on %s needs a trigger and none was found for it\n", sysfsPath);
+      return (false);
+    }
+    if (writeAttribute("trigger/current_trigger", current) == false)
+    {
+      printf("IIO trigger %s could not be attached to %s\n", current, sysfsPath);
+      return (false);
+    }
+  }
+
+  snprintf(value, sizeof(value), "%u", length);
+  if (writeAttribute("buffer/length", value) == false)
+    return (false);
+  if (writeAttribute("buffer/enable", "1") == false)
+  {
+    printf("IIO buffer on %s did not enable (trigger \"%s\"): %s\n", sysfsPath, current, strerror(errno));
+    return (false);
+  }
+
+  if ((fd = open(devPath, O_RDONLY | O_NONBLOCK)) < 0)
+  {
+    printf("Error while opening %s, Error: %s\n", devPath, strerror(errno));
+    writeAttribute("buffer/enable", "0");
+    return (false);
+  }
+  return (true);
+}
+
+void NAU7802_IIO::stopBuffer()
+{
+  if (fd < 0)
+    return;
+  close(fd);
+  fd = -1;
+  writeAttribute("buffer/enable", "0");
+}
+
+bool NAU7802_IIO::isBuffered()
+{
+  return (fd >= 0);
+}
+
+//Fetch every conversion already buffered by the kernel, up to maxSamples, with a single read()
+//Only timestamp_us and value are filled; NAU7802::readBuffered() stamps the rest.
+//Returns the number of samples written. Never blocks.
+size_t NAU7802_IIO::readSamples(NAU7802_Sample *out, size_t maxSamples)
+{
+  if (fd < 0 || maxSamples == 0)
+    return (0);
+
+  size_t wanted = maxSamples * storageBytes;
+  if (readBufferSize < wanted)
+  {
+    delete[] readBuffer;
+    readBuffer = new uint8_t[wanted];
+    readBufferSize = wanted;
+  }
+
+  ssize_t count = read(fd, readBuffer, wanted);
+  if (count <= 0)
+    return (0); //EAGAIN: nothing converted yet
+
+  //Timestamps are spread back from now at the nominal period; NAU7802_ClockEstimator refines them
+  size_t samples = count / storageBytes;
+  uint64_t now = NAU7802_timestamp();
+  uint32_t period = NAU7802_conversionPeriod(sampleRate);
+  for (size_t x = 0; x < samples; x++)
+  {
+    out[x].timestamp_us = now - (uint64_t)(samples - 1 - x) * period;
+    out[x].value = decode(&readBuffer[x * storageBytes]);
+  }
+  return (samples);
+}
+
+//Returns true if a conversion is waiting
+bool NAU7802_IIO::available()
+{
+  if (fd < 0)
+    return (true); //sysfs reads start their own conversion
+
+  struct pollfd waiting = {fd, POLLIN, 0};
+  return (poll(&waiting, 1, 0) > 0);
+}
+
+//One reading. Waits up to 1000ms for a buffered conversion; a sysfs read starts its own.
+bool NAU7802_IIO::readConversion(int32_t &value)
+{
+  if (fd >= 0)
+  {
+    struct pollfd waiting = {fd, POLLIN, 0};
+    NAU7802_Sample sample;
+    if (poll(&waiting, 1, 1000) <= 0 || readSamples(&sample, 1) != 1)
+      return (false);
+    value = sample.value;
+    return (true);
+  }
+
+  char attribute[32];
+  char text[24];
+  snprintf(attribute, sizeof(attribute), "in_voltage%u_raw", channel);
+  if (readAttribute(attribute, text, sizeof(text)) == false)
+    return (false);
+  value = atoi(text);
+  return (true);
+}
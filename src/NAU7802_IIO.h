@@ -0,0 +1,80 @@
+/*
+  Linux IIO transport for the NAU7802.
+
+  Instead of talking to the chip over i2c-dev, this uses the in-kernel
+  nau7802 IIO driver. Gain and rate are set through sysfs. Where the driver
+  offers a buffer (scan_elements present), conversions are streamed from
+  /dev/iio:deviceN and many are fetched with each read(), so there is no
+  syscall per sample. A triggered buffer only runs with a trigger attached,
+  so startBuffer() attaches the one asked for or the device's own from
+  /sys/bus/iio/devices/trigger*. Without a buffer, readings fall back to one
+  sysfs in_voltageN_raw read each.
+
+  The transport is not used on its own: hand it to NAU7802(NAU7802_IIO &)
+  and the usual reading, weight, tare and sample calls run on top of it, so
+  the filters and sinks don't care which transport is underneath. Register
+  level calls (setBit, calibrateAFE, ...) have no IIO equivalent; the driver
+  owns the chip and they fail.
+
+  Both the sysfs and /dev roots can be pointed elsewhere, which lets the
+  transport run against a fake tree in tests.
+*/
+
+#ifndef _NAU7802_IIO_h
+#define _NAU7802_IIO_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "NAU7802.h"
+
+class NAU7802_IIO
+{
+public:
+  NAU7802_IIO(uint8_t iio_device, const char *sysfsRoot = "/sys/bus/iio/devices", const char *devRoot = "/dev");
+  ~NAU7802_IIO();
+
+  bool begin();       //Checks the device is a nau7802 and reads its buffer format
+  bool isConnected(); //The IIO device exists and is a nau7802
+
+  bool setGain(uint8_t gainValue);        //NAU7802_GAIN_x, mapped onto the driver's scale list
+  bool setSampleRate(uint8_t rate);       //NAU7802_SPS_x
+  bool setChannel(uint8_t channelNumber); //NAU7802_CHANNEL_1 or NAU7802_CHANNEL_2. Stops a running buffer
+
+  bool startBuffer(uint32_t length = 256, const char *trigger = nullptr); //Enable kernel buffering, driven by the named trigger or the device's own. Returns false if the driver has no buffer support
+  void stopBuffer();
+  bool isBuffered();
+
+  size_t readSamples(NAU7802_Sample *out, size_t maxSamples); //Everything already converted, up to maxSamples, in one read(). Fills timestamp_us and value only. Never blocks
+  bool available();                                           //A conversion is waiting
+  bool readConversion(int32_t &value);                        //One reading. Waits up to 1000ms for a buffered conversion
+
+private:
+  bool readAttribute(const char *attribute, char *value, size_t length);
+  bool writeAttribute(const char *attribute, const char *value);
+  bool parseScanType();
+  bool findTrigger(char *trigger, size_t length);
+  int32_t decode(const uint8_t *raw);
+
+  char sysfsRoot[96];
+  char sysfsPath[128];
+  uint8_t iioDevice;
+  char devPath[64];
+  int fd;           //Buffer character device, -1 when not streaming
+  bool bufferCapable;
+
+  //Scan element format, e.g. "be:s24/32>>0"
+  bool bigEndian;
+  bool isSigned;
+  uint8_t realBits;
+  uint8_t storageBytes;
+  uint8_t shift;
+
+  uint8_t channel;
+  uint8_t sampleRate;
+
+  uint8_t *readBuffer;
+  size_t readBufferSize;
+};
+
+#endif
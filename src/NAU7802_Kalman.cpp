@@ -0,0 +1,123 @@
+/*
+  Scalar Kalman filter with adaptive process noise for NAU7802 readings.
+  See NAU7802_Kalman.h for the model.
+*/
+
+#include "NAU7802_Kalman.h"
+
+#include <math.h>
+
+#define NAU7802_KALMAN_Q_DECAY 0.8 //Per still sample, process noise falls back toward qStill by this factor
+
+NAU7802_Kalman::NAU7802_Kalman(uint8_t gain, uint8_t rate)
+{
+  threshold = 9; //3 sigma
+  configure(gain, rate);
+  reset();
+}
+
+//Take measurement noise from the noise profile and scale process noise to match
+void NAU7802_Kalman::configure(uint8_t gain, uint8_t rate)
+{
+  float noise = NAU7802_noiseCounts(gain, rate);
+  setMeasurementNoise(noise);
+  setProcessNoise(noise * 0.01f, noise * 100.0f);
+}
+
+void NAU7802_Kalman::configure(NAU7802 &device)
+{
+  configure(device.getGain(), device.getSampleRate());
+}
+
+void NAU7802_Kalman::setMeasurementNoise(float rmsCounts)
+{
+  r = rmsCounts * rmsCounts;
+  if (r <= 0)
+    r = 1;
+}
+
+void NAU7802_Kalman::setProcessNoise(float stillRms, float movingRms)
+{
+  qStill = stillRms * stillRms;
+  qMoving = movingRms * movingRms;
+  q = qStill;
+}
+
+void NAU7802_Kalman::setMotionThreshold(float sigmas)
+{
+  threshold = sigmas * sigmas;
+}
+
+void NAU7802_Kalman::reset()
+{
+  estimate = 0;
+  variance = 0;
+  q = qStill;
+  primed = false;
+  lastOutlier = false;
+}
+
+//Feed one raw reading and return the filtered estimate
+float NAU7802_Kalman::update(int32_t reading)
+{
+  if (primed == false)
+  {
+    estimate = reading;
+    variance = r;
+    primed = true;
+    return (estimate);
+  }
+
+  //Predict, then check whether the reading is plausible for a still load
+  double predicted = variance + q;
+  double innovation = reading - estimate;
+  double innovationVariance = predicted + r;
+
+  //One noise outlier past the threshold is expected now and then, so motion needs
+  //either two in a row or a single innovation far beyond the threshold
+  double ratio = innovation * innovation / innovationVariance;
+  bool outlier = ratio > threshold;
+  bool moving = (outlier && lastOutlier) || ratio > threshold * 16;
+  lastOutlier = outlier;
+
+  if (moving)
+  {
+    //Load is moving: trust the new reading almost completely
+    q = qMoving;
+    predicted = variance + q;
+    innovationVariance = predicted + r;
+  }
+  else
+  {
+    q = qStill + (q - qStill) * NAU7802_KALMAN_Q_DECAY;
+  }
+
+  double k = predicted / innovationVariance;
+  estimate += k * innovation;
+  variance = (1 - k) * predicted;
+  return (estimate);
+}
+
+//Filter a sample, keeping its timestamp and tags
+NAU7802_Sample NAU7802_Kalman::update(const NAU7802_Sample &sample)
+{
+  NAU7802_Sample filtered = sample;
+  update(sample.value);
+  filtered.value = (int32_t)lrint(estimate);
+  return (filtered);
+}
+
+float NAU7802_Kalman::getEstimate()
+{
+  return (estimate);
+}
+
+float NAU7802_Kalman::getVariance()
+{
+  return (variance);
+}
+
+bool NAU7802_Kalman::isMoving()
+{
+  return (q > qStill * 2);
+}
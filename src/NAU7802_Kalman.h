@@ -0,0 +1,54 @@
+/*
+  Scalar Kalman filter with adaptive process noise for NAU7802 readings.
+
+  The load is modelled as a random walk observed through the ADC's noise.
+  Measurement noise comes from the gain/rate noise profile (or a measured
+  figure). Process noise is kept tiny while the load is still, so static
+  readings average far more deeply than a fixed getAverage() window. When
+  the innovation becomes improbable for a still load, process noise is
+  raised so the estimate follows a step within a sample or two, then
+  decays back once the load settles.
+
+  update() is constant time and allocation free.
+*/
+
+#ifndef _NAU7802_Kalman_h
+#define _NAU7802_Kalman_h
+
+#include <stdint.h>
+
+#include "NAU7802.h"
+
+class NAU7802_Kalman
+{
+public:
+  NAU7802_Kalman(uint8_t gain = NAU7802_GAIN_128, uint8_t rate = NAU7802_SPS_80);
+
+  void configure(uint8_t gain, uint8_t rate);      //Take measurement noise from the noise profile
+  void configure(NAU7802 &device);                 //Same, using the device's cached gain and rate
+  void setMeasurementNoise(float rmsCounts);       //Override with a measured RMS noise
+  void setProcessNoise(float stillRms, float movingRms); //Expected change per sample in counts, still and in motion
+  void setMotionThreshold(float sigmas);           //Innovation size that counts as motion. Default 3
+  void reset();
+
+  float update(int32_t reading);                       //Feed one raw reading. Returns the filtered estimate
+  NAU7802_Sample update(const NAU7802_Sample &sample); //Same, keeping the sample's tags
+
+  float getEstimate();
+  float getVariance();  //Estimate variance in counts squared
+  bool isMoving();      //True while process noise is raised
+
+private:
+  //Double state: once settled the gain is ~0.01, and a float correction of a 24-bit estimate falls under its ULP
+  double estimate;
+  double variance;
+  double r;       //Measurement noise variance
+  double qStill;  //Process noise variance while still
+  double qMoving; //Process noise variance in motion
+  double q;       //Current process noise variance
+  double threshold; //Squared innovation threshold in units of its variance
+  bool primed;
+  bool lastOutlier; //Previous innovation was past the threshold
+};
+
+#endif
@@ -0,0 +1,113 @@
+/*
+  Seqlock protected "latest value" cell for the NAU7802.
+
+  A single writer (the thread that talks to the device) publishes the most
+  recent reading and weight. Any number of reader threads can fetch a
+  consistent copy without locking and without touching the I2C bus. Readers
+  retry only if they overlap a write, which lasts a handful of stores.
+*/
+
+#ifndef _NAU7802_Latest_h
+#define _NAU7802_Latest_h
+
+#include <atomic>
+#include <thread>
+
+#include "NAU7802_Sample.h"
+
+class NAU7802_Latest
+{
+public:
+  NAU7802_Latest() : seq(0), timestamp_us(0), value(0), weight(0.0f), tag(0), sequence(0) {}
+
+  //Publish a new reading. Only one thread may call this at a time.
+  void publish(const NAU7802_Sample &sample)
+  {
+    beginWrite();
+    timestamp_us.store(sample.timestamp_us, std::memory_order_relaxed);
+    value.store(sample.value, std::memory_order_relaxed);
+    tag.store(packTag(sample), std::memory_order_relaxed);
+    sequence.store(sample.sequence, std::memory_order_relaxed);
+    endWrite();
+  }
+
+  //Publish a new weight. Only one thread may call this at a time.
+  void publishWeight(float newWeight)
+  {
+    beginWrite();
+    weight.store(newWeight, std::memory_order_relaxed);
+    endWrite();
+  }
+
+  //Copy out the latest reading and weight. Safe from any number of threads.
+  //Returns false if nothing has been published yet.
+  bool read(NAU7802_Sample &sample, float &latestWeight) const
+  {
+    uint32_t before, after;
+    do
+    {
+      before = seq.load(std::memory_order_acquire);
+      if (before & 1)
+      {
+        std::this_thread::yield(); //Writer in progress
+        continue;
+      }
+
+      sample.timestamp_us = timestamp_us.load(std::memory_order_relaxed);
+      sample.value = value.load(std::memory_order_relaxed);
+      uint32_t packed = tag.load(std::memory_order_relaxed);
+      sample.sequence = sequence.load(std::memory_order_relaxed);
+      latestWeight = weight.load(std::memory_order_relaxed);
+      sample.device = packed & 0xFFFF;
+      sample.channel = (packed >> 16) & 0xFF;
+      sample.flags = packed >> 24;
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = seq.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+
+    return (before != 0);
+  }
+
+  bool read(NAU7802_Sample &sample) const
+  {
+    float unused;
+    return read(sample, unused);
+  }
+
+  float readWeight() const
+  {
+    NAU7802_Sample unused;
+    float latestWeight;
+    read(unused, latestWeight);
+    return (latestWeight);
+  }
+
+private:
+  void beginWrite()
+  {
+    seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  void endWrite()
+  {
+    seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  static uint32_t packTag(const NAU7802_Sample &sample)
+  {
+    return ((uint32_t)sample.flags << 24) | ((uint32_t)sample.channel << 16) | sample.device;
+  }
+
+  //Odd while a write is in progress. Each field is an atomic so readers racing
+  //with the writer are well defined; the sequence check discards torn copies.
+  std::atomic<uint32_t> seq;
+  std::atomic<uint64_t> timestamp_us;
+  std::atomic<int32_t> value;
+  std::atomic<float> weight;
+  std::atomic<uint32_t> tag;
+  std::atomic<uint32_t> sequence;
+};
+
+#endif
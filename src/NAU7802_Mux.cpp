@@ -0,0 +1,136 @@
+/*
+  TCA9548A style I2C multiplexer in front of several NAU7802s.
+  See NAU7802_Mux.h for the design.
+*/
+
+#include "NAU7802_Mux.h"
+
+NAU7802_Mux::NAU7802_Mux(uint8_t i2c_bus, uint8_t i2c_addr)
+{
+  this->i2c_bus = i2c_bus;
+  this->i2c_addr = i2c_addr;
+  fd = -1;
+  channel = NAU7802_MUX_NONE;
+  for (uint8_t x = 0; x < NAU7802_MUX_CHANNELS; x++)
+    masks[x] = 1 << x;
+  none = 0;
+  selects = 0;
+  skips = 0;
+}
+
+NAU7802_Mux::~NAU7802_Mux()
+{
+  if (fd >= 0)
+    close(fd);
+}
+
+bool NAU7802_Mux::begin()
+{
+  char device[32];
+  snprintf(device, sizeof(device), "/dev/i2c-%u", i2c_bus);
+  if ((fd = open(device, O_RDWR)) < 0)
+  {
+    printf("File descriptor opening error %s\n", strerror(errno));
+    return (false);
+  }
+  if (ioctl(fd, I2C_SLAVE, i2c_addr) < 0)
+  {
+    printf("Error While Opening I2C mux 0x%02X, Error Number: %d\n", i2c_addr, errno);
+    return (false);
+  }
+  return (deselect());
+}
+
+bool NAU7802_Mux::writeMask(uint8_t mask)
+{
+  if (i2c_smbus_write_byte(fd, mask) < 0)
+  {
+    printf("Error While setting I2C mux channel, Error#: %d\n", errno);
+    channel = NAU7802_MUX_NONE; //Can't tell what the mux did
+    return (false);
+  }
+  selects++;
+  return (true);
+}
+
+//Enable one downstream channel and disable the rest
+bool NAU7802_Mux::select(uint8_t newChannel)
+{
+  if (newChannel >= NAU7802_MUX_CHANNELS)
+    return (false);
+  if (newChannel == channel)
+  {
+    skips++;
+    return (true);
+  }
+
+  if (writeMask(masks[newChannel]) == false)
+    return (false);
+  channel = newChannel;
+  return (true);
+}
+
+bool NAU7802_Mux::deselect()
+{
+  if (writeMask(0) == false)
+    return (false);
+  channel = NAU7802_MUX_NONE;
+  return (true);
+}
+
+void NAU7802_Mux::invalidate()
+{
+  channel = NAU7802_MUX_NONE;
+}
+
+uint8_t NAU7802_Mux::getChannel()
+{
+  return (channel);
+}
+
+uint8_t NAU7802_Mux::getBus()
+{
+  return (i2c_bus);
+}
+
+uint8_t NAU7802_Mux::getAddress()
+{
+  return (i2c_addr);
+}
+
+uint32_t NAU7802_Mux::getSelectCount()
+{
+  return (selects);
+}
+
+uint32_t NAU7802_Mux::getSkipCount()
+{
+  return (skips);
+}
+
+//Write message that enables a channel, for an I2C_RDWR built elsewhere
+//Call selected() once the transfer carrying it succeeded
+struct i2c_msg NAU7802_Mux::selectMessage(uint8_t newChannel)
+{
+  struct i2c_msg message = {i2c_addr, 0, 1, &masks[newChannel % NAU7802_MUX_CHANNELS]};
+  return (message);
+}
+
+void NAU7802_Mux::selected(uint8_t newChannel)
+{
+  channel = newChannel;
+  selects++;
+}
+
+//Write message that disables every channel. Call deselected() once the transfer carrying it succeeded
+struct i2c_msg NAU7802_Mux::deselectMessage()
+{
+  struct i2c_msg message = {i2c_addr, 0, 1, &none};
+  return (message);
+}
+
+void NAU7802_Mux::deselected()
+{
+  channel = NAU7802_MUX_NONE;
+  selects++;
+}
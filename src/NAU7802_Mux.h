@@ -0,0 +1,75 @@
+/*
+  TCA9548A style I2C multiplexer in front of several NAU7802s.
+
+  Every NAU7802 answers at 0x2A, so boards with more than one put them behind
+  a mux and enable one downstream channel at a time. The mux remembers which
+  channel it last enabled and select() skips the write when a device on that
+  channel is addressed again, so consecutive transactions on one channel
+  cost nothing extra.
+
+  NAU7802 selects the channel and runs its transaction under one per-adapter
+  lock, so devices behind a mux can be driven from several threads. Several
+  muxes can share an adapter: NAU7802 remembers which mux last had a channel
+  enabled and deselects it before addressing a device behind another mux or
+  directly on the bus, otherwise two 0x2A devices answer at once. Calling
+  select() directly bypasses both the lock and that bookkeeping.
+*/
+
+#ifndef _NAU7802_Mux_h
+#define _NAU7802_Mux_h
+
+extern "C" {
+#include <i2c/smbus.h>
+}
+
+#include <fcntl.h>
+#include <linux/i2c-dev.h>
+#include <linux/i2c.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define NAU7802_MUX_CHANNELS 8
+#define NAU7802_MUX_NONE 0xFF //No channel enabled, or state unknown
+
+class NAU7802_Mux
+{
+public:
+  NAU7802_Mux(uint8_t i2c_bus, uint8_t i2c_addr = 0x70);
+  ~NAU7802_Mux();
+
+  bool begin();                //Open the adapter and disable every channel
+  bool select(uint8_t channel); //Enable only this channel. No I2C if it already is
+  bool deselect();              //Disable every channel
+  void invalidate();            //Forget the cached channel, e.g. after a bus error
+  uint8_t getChannel();         //Cached channel, or NAU7802_MUX_NONE
+
+  uint8_t getBus();
+  uint8_t getAddress();
+  uint32_t getSelectCount(); //Channel writes actually sent
+  uint32_t getSkipCount();   //select() calls served from the cache
+
+  //For building combined transfers: the messages that enable a channel or
+  //disable them all, and noting that such a message went out
+  struct i2c_msg selectMessage(uint8_t channel);
+  void selected(uint8_t channel);
+  struct i2c_msg deselectMessage();
+  void deselected();
+
+private:
+  bool writeMask(uint8_t mask);
+
+  int fd;
+  uint8_t i2c_bus;
+  uint8_t i2c_addr;
+  uint8_t channel;
+  uint8_t masks[NAU7802_MUX_CHANNELS]; //Stable buffers for selectMessage()
+  uint8_t none;                        //Stable buffer for deselectMessage()
+  uint32_t selects;
+  uint32_t skips;
+};
+
+#endif
@@ -0,0 +1,241 @@
+/*
+  Compact 8 byte sample records for history rings and shared memory.
+  See NAU7802_Packed.h for the design.
+*/
+
+#include "NAU7802_Packed.h"
+
+#include <string.h>
+#include <new>
+
+#define NAU7802_PACKED_MAGIC 0x4E415532 //"NAU2"
+
+static_assert(sizeof(NAU7802_Packed) == 8, "packed records must stay 8 bytes");
+static_assert(sizeof(std::atomic<uint64_t>) == 8, "records are stored as 64-bit atomics");
+
+void NAU7802_packBlock(const NAU7802_Sample *samples, NAU7802_Packed *out, size_t count, uint64_t base_us)
+{
+  for (size_t x = 0; x < count; x++)
+    out[x] = NAU7802_pack(samples[x], base_us);
+}
+
+void NAU7802_unpackBlock(const NAU7802_Packed *packed, NAU7802_Sample *out, size_t count, uint64_t base_us, uint16_t device, uint32_t firstSequence)
+{
+  for (size_t x = 0; x < count; x++)
+  {
+    NAU7802_unpack(packed[x], base_us, out[x]);
+    out[x].device = device;
+    out[x].sequence = firstSequence + x;
+  }
+}
+
+//A record and its 64-bit slot in the ring
+static inline uint64_t toSlot(const NAU7802_Packed &packed)
+{
+  uint64_t slot;
+  memcpy(&slot, &packed, sizeof(slot));
+  return (slot);
+}
+
+static inline NAU7802_Packed fromSlot(uint64_t slot)
+{
+  NAU7802_Packed packed;
+  memcpy(&packed, &slot, sizeof(packed));
+  return (packed);
+}
+
+//Bytes of memory a ring of this shape needs
+size_t NAU7802_PackedRing::getRequiredBytes(uint32_t blocks, uint32_t blockSamples)
+{
+  return (sizeof(Header) + (size_t)blocks * (sizeof(Block) + (size_t)blockSamples * sizeof(uint64_t)));
+}
+
+NAU7802_PackedRing::NAU7802_PackedRing(void *memory, size_t bytes, uint32_t blocks, uint32_t blockSamples)
+{
+  header = (Header *)memory;
+  blockMemory = (uint8_t *)memory + sizeof(Header);
+  blockBytes = sizeof(Block) + (size_t)blockSamples * sizeof(uint64_t);
+  current = nullptr;
+  currentBase_us = 0;
+  currentSequence = 0;
+  currentDevice = 0;
+  valid = (memory != nullptr && blocks > 0 && blockSamples > 0 && bytes >= getRequiredBytes(blocks, blockSamples));
+  if (valid == false)
+    return;
+
+  //Atomics are lock free, so constructing them in place works across processes too
+  header->magic = 0;
+  header->blocks = blocks;
+  header->blockSamples = blockSamples;
+  header->reserved = 0;
+  new (&header->started) std::atomic<uint64_t>(0);
+  for (uint32_t x = 0; x < blocks; x++)
+  {
+    Block *b = (Block *)(blockMemory + x * blockBytes);
+    new (&b->generation) std::atomic<uint32_t>(0);
+    new (&b->count) std::atomic<uint32_t>(0);
+    new (&b->number) std::atomic<uint64_t>(UINT64_MAX);
+    new (&b->base_us) std::atomic<uint64_t>(0);
+    new (&b->firstSequence) std::atomic<uint32_t>(0);
+    new (&b->device) std::atomic<uint32_t>(0);
+    for (uint32_t y = 0; y < blockSamples; y++)
+      new (&records(b)[y]) std::atomic<uint64_t>(0);
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+  header->magic = NAU7802_PACKED_MAGIC;
+}
+
+NAU7802_PackedRing::NAU7802_PackedRing(void *memory, size_t bytes)
+{
+  header = (Header *)memory;
+  blockMemory = (uint8_t *)memory + sizeof(Header);
+  current = nullptr;
+  currentBase_us = 0;
+  currentSequence = 0;
+  currentDevice = 0;
+  valid = (memory != nullptr && bytes >= sizeof(Header) && header->magic == NAU7802_PACKED_MAGIC &&
+           bytes >= getRequiredBytes(header->blocks, header->blockSamples));
+  blockBytes = valid ? sizeof(Block) + (size_t)header->blockSamples * sizeof(uint64_t) : 0;
+  std::atomic_thread_fence(std::memory_order_acquire);
+}
+
+bool NAU7802_PackedRing::isValid()
+{
+  return (valid);
+}
+
+NAU7802_PackedRing::Block *NAU7802_PackedRing::block(uint64_t number)
+{
+  return ((Block *)(blockMemory + (number % header->blocks) * blockBytes));
+}
+
+std::atomic<uint64_t> *NAU7802_PackedRing::records(Block *b)
+{
+  return ((std::atomic<uint64_t> *)((uint8_t *)b + sizeof(Block)));
+}
+
+//Take over the oldest block for a new run of samples starting with this one
+void NAU7802_PackedRing::open(const NAU7802_Sample &sample)
+{
+  uint64_t number = header->started.load(std::memory_order_relaxed);
+  Block *b = block(number);
+
+  //Readers seeing an odd generation, or a changed one after copying, throw their copy away
+  b->generation.store(b->generation.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  b->count.store(0, std::memory_order_relaxed);
+  b->number.store(number, std::memory_order_relaxed);
+  b->base_us.store(sample.timestamp_us, std::memory_order_relaxed);
+  b->firstSequence.store(sample.sequence, std::memory_order_relaxed);
+  b->device.store(sample.device, std::memory_order_relaxed);
+  b->generation.store(b->generation.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+
+  header->started.store(number + 1, std::memory_order_release);
+  current = b;
+  currentBase_us = sample.timestamp_us;
+  currentSequence = sample.sequence;
+  currentDevice = sample.device;
+}
+
+//Append one sample. Constant time except when a block is opened, which is also constant.
+bool NAU7802_PackedRing::add(const NAU7802_Sample &sample)
+{
+  if (valid == false)
+    return (false);
+
+  uint32_t count = current ? current->count.load(std::memory_order_relaxed) : 0;
+  if (current == nullptr || count >= header->blockSamples ||
+      NAU7802_fitsBlock(sample, currentBase_us, currentDevice, currentSequence) == false)
+  {
+    open(sample);
+    count = 0;
+  }
+
+  records(current)[count].store(toSlot(NAU7802_pack(sample, currentBase_us)), std::memory_order_relaxed);
+  current->count.store(count + 1, std::memory_order_release);
+  currentSequence++;
+  return (true);
+}
+
+size_t NAU7802_PackedRing::add(const NAU7802_Sample *samples, size_t count)
+{
+  size_t added = 0;
+  while (added < count && add(samples[added]))
+    added++;
+  return (added);
+}
+
+uint32_t NAU7802_PackedRing::getBlockCount()
+{
+  return (valid ? header->blocks : 0);
+}
+
+uint32_t NAU7802_PackedRing::getBlockSamples()
+{
+  return (valid ? header->blockSamples : 0);
+}
+
+uint64_t NAU7802_PackedRing::getBlocksStarted()
+{
+  return (valid ? header->started.load(std::memory_order_acquire) : 0);
+}
+
+//Copy out one block. Safe from any thread or process while the writer keeps adding.
+size_t NAU7802_PackedRing::readBlock(uint64_t number, NAU7802_Sample *out, size_t maxSamples, size_t first)
+{
+  if (valid == false)
+    return (0);
+
+  Block *b = block(number);
+  uint32_t before = b->generation.load(std::memory_order_acquire);
+  if ((before & 1) || b->number.load(std::memory_order_relaxed) != number)
+    return (0);
+
+  uint64_t base_us = b->base_us.load(std::memory_order_relaxed);
+  uint32_t firstSequence = b->firstSequence.load(std::memory_order_relaxed);
+  uint16_t device = b->device.load(std::memory_order_relaxed);
+  size_t count = b->count.load(std::memory_order_acquire);
+  count = count > first ? count - first : 0;
+  if (count > maxSamples)
+    count = maxSamples;
+
+  std::atomic<uint64_t> *slots = records(b) + first;
+  for (size_t x = 0; x < count; x++)
+  {
+    NAU7802_unpack(fromSlot(slots[x].load(std::memory_order_relaxed)), base_us, out[x]);
+    out[x].device = device;
+    out[x].sequence = firstSequence + first + x;
+  }
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (b->generation.load(std::memory_order_relaxed) != before)
+    return (0); //Reused while copying
+  return (count);
+}
+
+//Up to maxSamples of the newest history, oldest first
+size_t NAU7802_PackedRing::readLatest(NAU7802_Sample *out, size_t maxSamples)
+{
+  uint64_t started = getBlocksStarted();
+  if (started == 0)
+    return (0);
+
+  //Walk back from the open block until enough samples are covered
+  uint64_t oldest = started - 1;
+  size_t covered = block(oldest)->count.load(std::memory_order_acquire);
+  while (covered < maxSamples && oldest > 0 && started - oldest < header->blocks)
+  {
+    oldest--;
+    covered += block(oldest)->count.load(std::memory_order_acquire);
+  }
+
+  //Start part way into the oldest block so only the newest maxSamples are copied
+  size_t skip = covered > maxSamples ? covered - maxSamples : 0;
+  size_t written = 0;
+  for (uint64_t number = oldest; number < started && written < maxSamples; number++)
+  {
+    written += readBlock(number, &out[written], maxSamples - written, skip);
+    skip = 0;
+  }
+  return (written);
+}
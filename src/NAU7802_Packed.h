@@ -0,0 +1,128 @@
+/*
+  Compact 8 byte sample records for history rings and shared memory.
+
+  A full NAU7802_Sample is 24 bytes. Within one block of samples from one
+  device most of it is redundant: the device never changes, the sequence
+  counts up by one and timestamps sit close together. A packed record keeps
+  only what varies:
+
+    bits  0..23  value, 24-bit two's complement as the ADC produced it
+    bits 24..29  NAU7802_FLAG_ bits
+    bit  31      channel
+    next 32 bits timestamp in microseconds, signed, against the block base
+
+  The block supplies the base time, device and first sequence number. A
+  block must therefore hold one device with contiguous sequence numbers and
+  span less than 2^31 us (about 35 minutes).
+
+  NAU7802_PackedRing lays blocks of packed records out in memory the caller
+  provides: heap memory for in-process history, or a shm_open()/mmap()
+  region so other processes can read the history live. One process writes;
+  any number read without locks. Every block carries a generation count and
+  readers discard a block that was reused while they copied it.
+*/
+
+#ifndef _NAU7802_Packed_h
+#define _NAU7802_Packed_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#include "NAU7802_Sample.h"
+
+struct NAU7802_Packed
+{
+  uint32_t word;    //Value, flags and channel
+  int32_t delta_us; //Timestamp minus the block base
+};
+
+#define NAU7802_PACKED_FLAGS 0x3F //Flag bits a packed record keeps
+
+inline NAU7802_Packed NAU7802_pack(const NAU7802_Sample &sample, uint64_t base_us)
+{
+  int32_t value = sample.value;
+  value = value > NAU7802_READING_MAX ? NAU7802_READING_MAX : value; //Filter outputs may overshoot the rails
+  value = value < NAU7802_READING_MIN ? NAU7802_READING_MIN : value;
+
+  NAU7802_Packed packed;
+  packed.word = ((uint32_t)value & 0xFFFFFF) | ((uint32_t)(sample.flags & NAU7802_PACKED_FLAGS) << 24) | ((uint32_t)(sample.channel & 1) << 31);
+  packed.delta_us = (int32_t)(sample.timestamp_us - base_us);
+  return (packed);
+}
+
+//Device and sequence come from the block and are left alone
+inline void NAU7802_unpack(const NAU7802_Packed &packed, uint64_t base_us, NAU7802_Sample &sample)
+{
+  sample.value = (int32_t)(packed.word << 8) >> 8; //Sign extend the 24-bit value
+  sample.flags = (packed.word >> 24) & NAU7802_PACKED_FLAGS;
+  sample.channel = packed.word >> 31;
+  sample.timestamp_us = base_us + packed.delta_us;
+}
+
+//Whole arrays at once. Straight loops the compiler can vectorize.
+void NAU7802_packBlock(const NAU7802_Sample *samples, NAU7802_Packed *out, size_t count, uint64_t base_us);
+void NAU7802_unpackBlock(const NAU7802_Packed *packed, NAU7802_Sample *out, size_t count, uint64_t base_us, uint16_t device, uint32_t firstSequence);
+
+//True if sample can join a block with this base, device and next sequence
+inline bool NAU7802_fitsBlock(const NAU7802_Sample &sample, uint64_t base_us, uint16_t device, uint32_t nextSequence)
+{
+  return sample.device == device && sample.sequence == nextSequence &&
+         sample.timestamp_us >= base_us && sample.timestamp_us - base_us < 0x80000000ULL;
+}
+
+class NAU7802_PackedRing
+{
+public:
+  static size_t getRequiredBytes(uint32_t blocks, uint32_t blockSamples);
+
+  NAU7802_PackedRing(void *memory, size_t bytes, uint32_t blocks, uint32_t blockSamples); //Writer: formats the memory
+  NAU7802_PackedRing(void *memory, size_t bytes);                                         //Reader: attaches to memory a writer formatted
+  bool isValid(); //False if the memory was too small or not formatted
+
+  bool add(const NAU7802_Sample &sample); //Writer only. Starts a new block when the sample can't join the open one
+  size_t add(const NAU7802_Sample *samples, size_t count);
+
+  uint32_t getBlockCount();
+  uint32_t getBlockSamples();
+  uint64_t getBlocksStarted(); //Block numbers run from getBlocksStarted() - getBlockCount() (if positive) to getBlocksStarted() - 1
+
+  size_t readBlock(uint64_t block, NAU7802_Sample *out, size_t maxSamples, size_t first = 0); //Samples of one block from record first on, oldest first. 0 if it was overwritten
+  size_t readLatest(NAU7802_Sample *out, size_t maxSamples);                 //Most recent samples across blocks, oldest first
+
+private:
+  struct Header
+  {
+    uint32_t magic;
+    uint32_t blocks;
+    uint32_t blockSamples;
+    uint32_t reserved;
+    std::atomic<uint64_t> started; //Blocks started since formatting
+  };
+
+  struct Block
+  {
+    std::atomic<uint32_t> generation; //Odd while the block is being reset
+    std::atomic<uint32_t> count;      //Records published
+    std::atomic<uint64_t> number;     //Which block this currently is
+    std::atomic<uint64_t> base_us;    //Atomic like the rest, so readers racing a reset are well defined
+    std::atomic<uint32_t> firstSequence;
+    std::atomic<uint32_t> device;
+  };
+
+  Block *block(uint64_t number);
+  std::atomic<uint64_t> *records(Block *b);
+  void open(const NAU7802_Sample &sample);
+
+  Header *header;
+  uint8_t *blockMemory;
+  size_t blockBytes;
+  bool valid;
+
+  Block *current; //Writer's open block
+  uint64_t currentBase_us;
+  uint32_t currentSequence; //Sequence the next sample must have
+  uint16_t currentDevice;
+};
+
+#endif
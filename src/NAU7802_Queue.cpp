@@ -0,0 +1,226 @@
+/*
+  Multi-producer, single-consumer sample queue for merging many NAU7802s.
+  See NAU7802_Queue.h for the design.
+*/
+
+#include "NAU7802_Queue.h"
+
+#include <thread>
+
+NAU7802_Queue::NAU7802_Queue(uint8_t maxProducers, uint32_t capacity, NAU7802_Queue_Policy policy)
+{
+  uint32_t size = 2;
+  while (size < capacity)
+    size <<= 1; //Round up to a power of two so indexes can be masked
+
+  this->maxProducers = maxProducers;
+  this->capacity = size;
+  this->mask = size - 1;
+  this->policy = policy;
+  producerCount = 0;
+
+  producers = new Producer[maxProducers];
+  for (uint8_t x = 0; x < maxProducers; x++)
+  {
+    producers[x].head = 0;
+    producers[x].tail = 0;
+    producers[x].dropped = 0;
+    producers[x].ring = new NAU7802_Sample[size];
+  }
+}
+
+NAU7802_Queue::~NAU7802_Queue()
+{
+  for (uint8_t x = 0; x < maxProducers; x++)
+    delete[] producers[x].ring;
+  delete[] producers;
+}
+
+//Register a producer. Each producer thread must use its own index.
+int NAU7802_Queue::addProducer()
+{
+  uint8_t index = producerCount.load();
+  do
+  {
+    if (index >= maxProducers)
+      return (-1);
+  } while (producerCount.compare_exchange_weak(index, index + 1) == false);
+  return (index);
+}
+
+//Make room for up to wanted samples at tail according to the queue policy
+//Returns how many slots the producer may fill
+uint32_t NAU7802_Queue::reserve(Producer &p, uint64_t tail, uint32_t wanted)
+{
+  uint64_t head = p.head.load(std::memory_order_acquire);
+  uint32_t space = capacity - (uint32_t)(tail - head);
+  if (space >= wanted)
+    return (wanted);
+
+  if (policy == NAU7802_QUEUE_DROP_NEWEST)
+  {
+    p.dropped.fetch_add(wanted - space, std::memory_order_relaxed);
+    return (space);
+  }
+
+  if (policy == NAU7802_QUEUE_BLOCK)
+  {
+    while (capacity - (uint32_t)(tail - p.head.load(std::memory_order_acquire)) < wanted)
+      std::this_thread::yield();
+    return (wanted);
+  }
+
+  //Drop oldest: push head forward so the ring never holds more than capacity
+  if (wanted > capacity)
+    wanted = capacity;
+  uint64_t needed = tail + wanted - capacity;
+  while (head < needed)
+  {
+    if (p.head.compare_exchange_weak(head, needed, std::memory_order_acq_rel))
+    {
+      p.dropped.fetch_add(needed - head, std::memory_order_relaxed);
+      break;
+    }
+    //head was reloaded; the consumer may already have made room
+  }
+  return (wanted);
+}
+
+//Queue one sample. Wait free unless the policy is NAU7802_QUEUE_BLOCK.
+//Returns false if a sample was dropped to make this push fit.
+bool NAU7802_Queue::push(uint8_t producer, const NAU7802_Sample &sample)
+{
+  uint64_t droppedBefore = getDropped(producer); //Only this producer changes its drop counter
+  if (pushBatch(producer, &sample, 1) != 1)
+    return (false);
+  return (getDropped(producer) == droppedBefore);
+}
+
+//Queue a batch of samples from one producer, published with a single release store
+//Under NAU7802_QUEUE_BLOCK a batch larger than the ring goes out in pieces as the consumer makes room.
+//Returns the number of samples from the batch that were queued
+uint32_t NAU7802_Queue::pushBatch(uint8_t producer, const NAU7802_Sample *samples, uint32_t count)
+{
+  if (producer >= maxProducers || count == 0)
+    return (0);
+
+  Producer &p = producers[producer];
+  uint64_t tail = p.tail.load(std::memory_order_relaxed);
+
+  if (policy == NAU7802_QUEUE_BLOCK && count > capacity)
+  {
+    uint32_t done = 0;
+    while (done < count)
+    {
+      uint32_t space;
+      while ((space = capacity - (uint32_t)(tail - p.head.load(std::memory_order_acquire))) == 0)
+        std::this_thread::yield();
+
+      uint32_t chunk = (count - done < space) ? count - done : space;
+      for (uint32_t x = 0; x < chunk; x++)
+        p.ring[(tail + x) & mask] = samples[done + x];
+      tail += chunk;
+      p.tail.store(tail, std::memory_order_release);
+      done += chunk;
+    }
+    return (count);
+  }
+
+  //Anything that can't fit even in an empty ring is the oldest part of the batch
+  uint32_t skip = 0;
+  if (count > capacity && policy != NAU7802_QUEUE_DROP_NEWEST)
+  {
+    skip = count - capacity;
+    p.dropped.fetch_add(skip, std::memory_order_relaxed);
+  }
+
+  uint32_t accepted = reserve(p, tail, count - skip);
+  for (uint32_t x = 0; x < accepted; x++)
+    p.ring[(tail + x) & mask] = samples[skip + x];
+
+  p.tail.store(tail + accepted, std::memory_order_release);
+  return (accepted);
+}
+
+//Drain up to maxSamples, merged oldest-first across all producers
+//Must only be called from the single consumer thread
+size_t NAU7802_Queue::drain(NAU7802_Sample *out, size_t maxSamples)
+{
+  uint8_t count = producerCount.load(std::memory_order_acquire);
+  size_t taken = 0;
+
+  while (taken < maxSamples)
+  {
+    //Pick the producer whose oldest queued sample is oldest
+    int best = -1;
+    uint64_t bestHead = 0;
+    uint64_t bestTime = 0;
+    for (uint8_t x = 0; x < count; x++)
+    {
+      Producer &p = producers[x];
+      uint64_t head = p.head.load(std::memory_order_acquire);
+      if (head == p.tail.load(std::memory_order_acquire))
+        continue; //Empty
+
+      uint64_t stamp = p.ring[head & mask].timestamp_us;
+      if (best < 0 || stamp < bestTime)
+      {
+        best = x;
+        bestHead = head;
+        bestTime = stamp;
+      }
+    }
+
+    if (best < 0)
+      break; //Everything is empty
+
+    Producer &p = producers[best];
+    out[taken] = p.ring[bestHead & mask];
+
+    if (policy == NAU7802_QUEUE_DROP_OLDEST)
+    {
+      //The producer may have discarded this slot while we were copying it.
+      //It can only overwrite the slot after moving head past it, so a
+      //successful exchange proves the copy is intact.
+      if (p.head.compare_exchange_strong(bestHead, bestHead + 1, std::memory_order_acq_rel) == false)
+        continue;
+    }
+    else
+    {
+      p.head.store(bestHead + 1, std::memory_order_release);
+    }
+    taken++;
+  }
+
+  return (taken);
+}
+
+//Approximate number of samples waiting across all producers
+size_t NAU7802_Queue::size()
+{
+  size_t total = 0;
+  uint8_t count = producerCount.load(std::memory_order_acquire);
+  for (uint8_t x = 0; x < count; x++)
+    total += producers[x].tail.load(std::memory_order_acquire) - producers[x].head.load(std::memory_order_acquire);
+  return (total);
+}
+
+uint64_t NAU7802_Queue::getDropped(uint8_t producer)
+{
+  if (producer >= maxProducers)
+    return (0);
+  return (producers[producer].dropped.load(std::memory_order_relaxed));
+}
+
+uint64_t NAU7802_Queue::getDropped()
+{
+  uint64_t total = 0;
+  for (uint8_t x = 0; x < maxProducers; x++)
+    total += producers[x].dropped.load(std::memory_order_relaxed);
+  return (total);
+}
+
+NAU7802_Queue_Policy NAU7802_Queue::getPolicy()
+{
+  return (policy);
+}
@@ -0,0 +1,70 @@
+/*
+  Multi-producer, single-consumer sample queue for merging many NAU7802s.
+
+  Each producer (typically one acquisition thread per device or per bus)
+  owns a private ring. Publishing is a copy into that ring followed by one
+  release store, so producers never contend with each other. The single
+  consumer drains all rings at once and merges them in approximate
+  timestamp order: samples come out oldest-first across the rings that were
+  non-empty when the drain started.
+
+  When a producer's ring is full the queue's policy decides what happens:
+  drop the oldest queued sample, drop the new sample, or block the producer
+  until the consumer catches up. Every dropped sample is counted.
+*/
+
+#ifndef _NAU7802_Queue_h
+#define _NAU7802_Queue_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#include "NAU7802_Sample.h"
+
+//What to do when a producer's ring is full
+typedef enum
+{
+  NAU7802_QUEUE_DROP_OLDEST = 0, //Overwrite the oldest queued sample
+  NAU7802_QUEUE_DROP_NEWEST,     //Discard the sample being pushed
+  NAU7802_QUEUE_BLOCK,           //Wait for the consumer to make room
+} NAU7802_Queue_Policy;
+
+class NAU7802_Queue
+{
+public:
+  NAU7802_Queue(uint8_t maxProducers, uint32_t capacity = 1024, NAU7802_Queue_Policy policy = NAU7802_QUEUE_DROP_OLDEST); //Capacity per producer, rounded up to a power of two
+  ~NAU7802_Queue();
+
+  int addProducer(); //Register a producer. Returns its index, or -1 if maxProducers are already registered
+
+  bool push(uint8_t producer, const NAU7802_Sample &sample);                    //Returns false if a sample was dropped
+  uint32_t pushBatch(uint8_t producer, const NAU7802_Sample *samples, uint32_t count); //Publishes the whole batch with one store, or in pieces if it must block. Returns number of samples accepted
+
+  size_t drain(NAU7802_Sample *out, size_t maxSamples); //Consumer only. Merged oldest-first across producers
+  size_t size();                                        //Approximate number of queued samples
+
+  uint64_t getDropped(uint8_t producer); //Samples dropped by one producer's ring
+  uint64_t getDropped();                 //Samples dropped across all producers
+  NAU7802_Queue_Policy getPolicy();
+
+private:
+  struct Producer
+  {
+    alignas(64) std::atomic<uint64_t> head; //Next slot the consumer reads
+    alignas(64) std::atomic<uint64_t> tail; //Next slot the producer writes
+    std::atomic<uint64_t> dropped;
+    NAU7802_Sample *ring;
+  };
+
+  uint32_t reserve(Producer &p, uint64_t tail, uint32_t wanted);
+
+  Producer *producers;
+  uint8_t maxProducers;
+  std::atomic<uint8_t> producerCount;
+  uint32_t capacity;
+  uint32_t mask;
+  NAU7802_Queue_Policy policy;
+};
+
+#endif
@@ -0,0 +1,213 @@
+/*
+  Streaming polyphase resampler for NAU7802 sample streams.
+  See NAU7802_Resampler.h for the design.
+*/
+
+#include "NAU7802_Resampler.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__GNUC__)
+typedef float NAU7802_f4 __attribute__((vector_size(16)));
+#endif
+
+NAU7802_Resampler::NAU7802_Resampler(float outputRate_hz, float inputRate_hz, uint8_t baseTaps, uint8_t phases)
+{
+  outputPeriod_us = 1E6 / outputRate_hz;
+  inputPeriod_us = 1E6 / inputRate_hz;
+  this->phases = phases < 1 ? 1 : phases;
+
+  //When decimating, widen the kernel so its cutoff sits below the output Nyquist rate
+  float ratio = inputRate_hz / outputRate_hz;
+  float stretch = ratio > 1 ? ratio : 1;
+  uint16_t span = (uint16_t)ceilf(baseTaps * stretch);
+  taps = (span + 3) & ~3; //Round up to whole vectors
+  if (taps < 4)
+    taps = 4;
+
+  //Windowed sinc with cutoff in cycles per input sample, 10% guard band
+  double cutoff = 0.5 / stretch * 0.9;
+  table = new float[(this->phases + 1) * taps];
+  for (uint16_t p = 0; p <= this->phases; p++)
+  {
+    double frac = (double)p / this->phases;
+    double sum = 0;
+    float *row = &table[p * taps];
+    for (uint16_t k = 0; k < taps; k++)
+    {
+      //Distance from tap k to the interpolation point, in input samples
+      double t = (double)k - (taps / 2 - 1) - frac;
+      double w = 0.42 + 0.5 * cos(M_PI * t / (taps / 2.0)) + 0.08 * cos(2 * M_PI * t / (taps / 2.0));
+      if (fabs(t) >= taps / 2.0)
+        w = 0;
+      double x = 2 * cutoff * t;
+      double sinc = (fabs(x) < 1E-9) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+      row[k] = 2 * cutoff * sinc * w;
+      sum += row[k];
+    }
+    for (uint16_t k = 0; k < taps; k++)
+      row[k] /= sum; //Unity gain at DC for every phase
+  }
+
+  historySize = 2;
+  while (historySize < taps)
+    historySize <<= 1;
+  history = new float[2 * historySize];
+  flagHistory = new uint8_t[historySize];
+
+  reset();
+}
+
+NAU7802_Resampler::~NAU7802_Resampler()
+{
+  delete[] table;
+  delete[] history;
+  delete[] flagHistory;
+}
+
+void NAU7802_Resampler::reset()
+{
+  memset(history, 0, 2 * historySize * sizeof(float));
+  memset(flagHistory, 0, historySize);
+  written = 0;
+  lastTime_us = 0;
+  lastValue = 0;
+  nextOutput_us = 0;
+  memset(&last, 0, sizeof(last));
+}
+
+void NAU7802_Resampler::store(float value, uint8_t flags)
+{
+  uint32_t slot = written & (historySize - 1);
+  history[slot] = value;
+  history[slot + historySize] = value;
+  flagHistory[slot] = flags;
+  written++;
+}
+
+//Filter output at a point 'back' input samples before the newest stored sample
+//flags collects the flags of every input under the kernel
+float NAU7802_Resampler::filterAt(uint32_t newest, double back, uint8_t &flags)
+{
+  double position = (double)newest - back;
+  double whole = floor(position);
+  double frac = position - whole;
+
+  double phase = frac * phases;
+  uint16_t p = (uint16_t)phase;
+  if (p >= phases)
+    p = phases - 1;
+  float blend = (float)(phase - p);
+
+  //Oldest input in the window, placed so the point sits between taps/2-1 and taps/2
+  uint32_t first = (uint32_t)whole - (taps / 2 - 1);
+  const float *x = &history[first & (historySize - 1)];
+  const float *c0 = &table[p * taps];
+  const float *c1 = c0 + taps;
+
+  flags = 0;
+  for (uint16_t k = 0; k < taps; k++)
+    flags |= flagHistory[(first + k) & (historySize - 1)];
+
+  //The kernel is symmetric, so tap k pairs directly with the input k samples after 'first'
+  float y0 = 0, y1 = 0;
+#if defined(__GNUC__)
+  NAU7802_f4 a0 = {0, 0, 0, 0};
+  NAU7802_f4 a1 = {0, 0, 0, 0};
+  for (uint16_t k = 0; k < taps; k += 4)
+  {
+    NAU7802_f4 v, w0, w1;
+    memcpy(&v, &x[k], sizeof(v)); //Unaligned loads
+    memcpy(&w0, &c0[k], sizeof(w0));
+    memcpy(&w1, &c1[k], sizeof(w1));
+    a0 += v * w0;
+    a1 += v * w1;
+  }
+  y0 = a0[0] + a0[1] + a0[2] + a0[3];
+  y1 = a1[0] + a1[1] + a1[2] + a1[3];
+#else
+  for (uint16_t k = 0; k < taps; k++)
+  {
+    y0 += x[k] * c0[k];
+    y1 += x[k] * c1[k];
+  }
+#endif
+  return (y0 + blend * (y1 - y0));
+}
+
+//Feed one input sample. Writes any output instants that are now fully covered by input.
+size_t NAU7802_Resampler::push(const NAU7802_Sample &sample, NAU7802_Sample *out, size_t maxOut)
+{
+  float value = (float)sample.value;
+
+  if (written == 0)
+  {
+    //Prime the history so the first outputs don't ramp up from zero
+    for (uint32_t x = 0; x < historySize; x++)
+      store(value, sample.flags);
+    lastTime_us = sample.timestamp_us;
+    lastValue = value;
+    last = sample;
+    nextOutput_us = ((uint64_t)(sample.timestamp_us / outputPeriod_us) + 1) * outputPeriod_us;
+    return (0);
+  }
+
+  if (sample.timestamp_us <= lastTime_us)
+    return (0); //Out of order or duplicate
+
+  //Follow slow input rate changes; whole multiples of the period are skipped conversions
+  double elapsed = (double)(sample.timestamp_us - lastTime_us);
+  double steps = floor(elapsed / inputPeriod_us + 0.5);
+  if (steps < 1)
+    steps = 1;
+  inputPeriod_us += (elapsed / steps - inputPeriod_us) / 32;
+
+  //Fill conversions missing from the stream
+  for (uint32_t x = 1; x < (uint32_t)steps && x < historySize; x++)
+    store(lastValue + (value - lastValue) * (float)(x / steps), NAU7802_FLAG_INTERPOLATED);
+  store(value, sample.flags);
+  lastTime_us = sample.timestamp_us;
+  lastValue = value;
+  last = sample;
+
+  //An output instant can be produced once half the filter span of input follows it
+  size_t produced = 0;
+  double guard = (taps / 2.0) * inputPeriod_us;
+  while (produced < maxOut && nextOutput_us + guard <= (double)lastTime_us)
+  {
+    double back = (double)(lastTime_us - nextOutput_us) / inputPeriod_us;
+    uint8_t flags;
+    float y = filterAt(written - 1, back, flags);
+
+    out[produced] = last;
+    out[produced].timestamp_us = nextOutput_us;
+    out[produced].value = (int32_t)lrintf(y);
+    out[produced].flags = flags | NAU7802_FLAG_INTERPOLATED;
+    produced++;
+    nextOutput_us = (uint64_t)(llround((nextOutput_us + outputPeriod_us) / outputPeriod_us) * outputPeriod_us);
+  }
+
+  //Drop instants that fell too far behind to cover, e.g. after a long gap
+  double oldest = (double)lastTime_us - (historySize - taps / 2) * inputPeriod_us;
+  while ((double)nextOutput_us < oldest)
+    nextOutput_us = (uint64_t)(llround((nextOutput_us + outputPeriod_us) / outputPeriod_us) * outputPeriod_us);
+
+  return (produced);
+}
+
+//Microseconds from an output instant until it is produced
+uint32_t NAU7802_Resampler::getLatency()
+{
+  return ((uint32_t)((taps / 2.0) * inputPeriod_us));
+}
+
+float NAU7802_Resampler::getInputPeriod()
+{
+  return (inputPeriod_us);
+}
+
+uint16_t NAU7802_Resampler::getTapCount()
+{
+  return (taps);
+}
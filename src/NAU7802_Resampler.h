@@ -0,0 +1,69 @@
+/*
+  Streaming polyphase resampler for NAU7802 sample streams.
+
+  Converts one device's stream (at 10/20/40/80/320 SPS, each with its own
+  real rate) to a fixed output rate on the host clock. Output instants are
+  exact multiples of the output period on the steady clock, so every cell
+  resampled to the same rate lands on the same instants and can be combined
+  directly.
+
+  The interpolation filter is a Blackman windowed sinc, low passed below the
+  lower of the two Nyquist rates so decimation doesn't alias. It is stored
+  as a polyphase table and the fractional delay between two adjacent phases
+  is linearly interpolated, so any rate ratio and slowly drifting input
+  rates are handled without recomputing coefficients. Inner loops run on
+  4-wide vectors where the compiler supports GCC vector extensions (SSE,
+  NEON).
+
+  Input timestamps should be the reconstructed conversion times from
+  NAU7802_ClockEstimator; conversions missing from the stream are filled by
+  linear interpolation. Latency is fixed at half the filter span.
+
+  Every output carries NAU7802_FLAG_INTERPOLATED plus the flags of all
+  inputs under the kernel, so one saturated or settling conversion marks
+  each output it contributed to.
+*/
+
+#ifndef _NAU7802_Resampler_h
+#define _NAU7802_Resampler_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "NAU7802_Sample.h"
+
+class NAU7802_Resampler
+{
+public:
+  NAU7802_Resampler(float outputRate_hz, float inputRate_hz, uint8_t taps = 8, uint8_t phases = 32); //taps is the filter span in input samples when not decimating
+  ~NAU7802_Resampler();
+
+  size_t push(const NAU7802_Sample &sample, NAU7802_Sample *out, size_t maxOut); //Feed one input sample. Returns number of output samples written
+  void reset();
+
+  uint32_t getLatency();    //Microseconds from an output instant until it is produced
+  float getInputPeriod();   //Tracked input period in microseconds
+  uint16_t getTapCount();   //Filter span in input samples
+
+private:
+  float filterAt(uint32_t newest, double back, uint8_t &flags);
+  void store(float value, uint8_t flags);
+
+  double outputPeriod_us;
+  double inputPeriod_us;
+  uint16_t taps; //Multiple of 4
+  uint8_t phases;
+  float *table;  //(phases + 1) rows of taps coefficients
+
+  float *history; //Each value stored twice so any window of taps values is contiguous
+  uint8_t *flagHistory; //Flags of each stored value, stored once
+  uint32_t historySize;
+  uint32_t written;
+
+  uint64_t lastTime_us;
+  float lastValue;
+  uint64_t nextOutput_us;
+  NAU7802_Sample last;
+};
+
+#endif
@@ -0,0 +1,180 @@
+/*
+  Threaded acquisition runtime for hosts with several I2C adapters.
+  See NAU7802_Runtime.h for the design.
+*/
+
+#include "NAU7802_Runtime.h"
+
+NAU7802_Runtime::NAU7802_Runtime(uint8_t poolThreads) : pool(poolThreads)
+{
+  queue = nullptr;
+  running = false;
+}
+
+NAU7802_Runtime::~NAU7802_Runtime()
+{
+  stop();
+  for (size_t x = 0; x < buses.size(); x++)
+  {
+    for (size_t y = 0; y < buses[x]->strands.size(); y++)
+      delete buses[x]->strands[y];
+    delete buses[x];
+  }
+}
+
+//Add a device to the worker that owns its adapter. The optional stage runs on the pool for every sample.
+//Returns false if the runtime is already running or the adapter's bandwidth budget can't fit the device.
+bool NAU7802_Runtime::addDevice(NAU7802 &device, NAU7802_Stage stage)
+{
+  if (running)
+    return (false);
+
+  Bus *owner = nullptr;
+  for (size_t x = 0; x < buses.size(); x++)
+  {
+    if (buses[x]->number == device.getBus())
+      owner = buses[x];
+  }
+
+  if (owner == nullptr)
+  {
+    owner = new Bus;
+    owner->number = device.getBus();
+    owner->producer = -1;
+    buses.push_back(owner);
+  }
+
+  if (owner->scheduler.addDevice(device) < 0)
+    return (false);
+  Strand *strand = new Strand;
+  strand->stage = stage;
+  strand->scheduled = false;
+  owner->strands.push_back(strand);
+  return (true);
+}
+
+//Every sample is also pushed into this queue, one producer per bus worker
+void NAU7802_Runtime::setQueue(NAU7802_Queue *newQueue)
+{
+  queue = newQueue;
+}
+
+//Start one worker per adapter. Returns false if already running or the queue has too few producer slots.
+bool NAU7802_Runtime::start()
+{
+  if (running)
+    return (false);
+
+  for (size_t x = 0; x < buses.size(); x++)
+  {
+    if (queue != nullptr && buses[x]->producer < 0)
+    {
+      buses[x]->producer = queue->addProducer();
+      if (buses[x]->producer < 0)
+        return (false);
+    }
+  }
+
+  running = true;
+  for (size_t x = 0; x < buses.size(); x++)
+    buses[x]->thread = std::thread(&NAU7802_Runtime::runBus, this, buses[x]);
+  return (true);
+}
+
+//Stop the bus workers and wait for queued stages to finish
+void NAU7802_Runtime::stop()
+{
+  if (running == false)
+    return;
+
+  running = false;
+  for (size_t x = 0; x < buses.size(); x++)
+  {
+    if (buses[x]->thread.joinable())
+      buses[x]->thread.join();
+  }
+  pool.waitIdle();
+}
+
+bool NAU7802_Runtime::isRunning()
+{
+  return (running);
+}
+
+uint8_t NAU7802_Runtime::getBusCount()
+{
+  return (buses.size());
+}
+
+//Scheduler owning /dev/i2c-N. Use it to queue configuration or read deadline misses.
+NAU7802_Scheduler *NAU7802_Runtime::getScheduler(uint8_t i2c_bus)
+{
+  for (size_t x = 0; x < buses.size(); x++)
+  {
+    if (buses[x]->number == i2c_bus)
+      return (&buses[x]->scheduler);
+  }
+  return (nullptr);
+}
+
+NAU7802_WorkPool &NAU7802_Runtime::getPool()
+{
+  return (pool);
+}
+
+//Bus worker. Lets the scheduler pick each transaction and hands samples off; never runs stages itself.
+void NAU7802_Runtime::runBus(Bus *bus)
+{
+  NAU7802_Sample sample;
+  uint32_t idle_us;
+
+  while (running)
+  {
+    int slot = bus->scheduler.runNext(sample, idle_us);
+    if (slot < 0)
+    {
+      if (idle_us > 0)
+        usleep(idle_us > 1000 ? 1000 : idle_us); //Wake at least every ms to notice stop()
+      continue;
+    }
+
+    if (queue != nullptr)
+      queue->push(bus->producer, sample);
+
+    if (bus->strands[slot]->stage)
+      dispatch(bus->strands[slot], sample);
+  }
+}
+
+//Queue a sample for a device's stage, starting a pool task if none is draining it
+void NAU7802_Runtime::dispatch(Strand *strand, const NAU7802_Sample &sample)
+{
+  {
+    std::lock_guard<std::mutex> guard(strand->lock);
+    strand->pending.push_back(sample);
+    if (strand->scheduled)
+      return; //The running task will pick it up
+    strand->scheduled = true;
+  }
+  pool.submit([strand] { drain(strand); });
+}
+
+//Run a device's stage over its pending samples in order
+void NAU7802_Runtime::drain(Strand *strand)
+{
+  NAU7802_Sample sample;
+  while (1)
+  {
+    {
+      std::lock_guard<std::mutex> guard(strand->lock);
+      if (strand->pending.empty())
+      {
+        strand->scheduled = false;
+        return;
+      }
+      sample = strand->pending.front();
+      strand->pending.pop_front();
+    }
+    strand->stage(sample);
+  }
+}
@@ -0,0 +1,84 @@
+/*
+  Threaded acquisition runtime for hosts with several I2C adapters.
+
+  An I2C adapter can only run one transaction at a time, so each
+  /dev/i2c-N gets exactly one worker thread that owns every device on it.
+  Bus workers only move bytes. Reads are ordered by an earliest deadline
+  first scheduler (NAU7802_Scheduler); when a conversion is read it is
+  published to the device's latest-value cell and optional output queue,
+  and any processing stage is handed off to a shared work stealing pool. Slow
+  filters therefore never hold up I/O on any adapter. A device's stage sees
+  its samples one at a time and in order, so stages may keep state.
+
+  Devices must already be set up with begin() before the runtime starts.
+  While it runs, the runtime's bus worker is the only thread that may talk
+  to a device; other threads use getLatest() or the output queue, and change
+  settings through the bus scheduler's queueConfig().
+*/
+
+#ifndef _NAU7802_Runtime_h
+#define _NAU7802_Runtime_h
+
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "NAU7802.h"
+#include "NAU7802_Queue.h"
+#include "NAU7802_Scheduler.h"
+#include "NAU7802_WorkPool.h"
+
+//Processing stage run on the work pool for every sample
+typedef std::function<void(const NAU7802_Sample &)> NAU7802_Stage;
+
+class NAU7802_Runtime
+{
+public:
+  NAU7802_Runtime(uint8_t poolThreads = 0); //0 picks one pool thread per hardware core
+  ~NAU7802_Runtime();                       //Stops the workers if still running
+
+  bool addDevice(NAU7802 &device, NAU7802_Stage stage = nullptr); //Must be called before start()
+  void setQueue(NAU7802_Queue *queue);                            //Also push every sample into this queue. One producer per bus.
+
+  bool start();
+  void stop();
+  bool isRunning();
+
+  uint8_t getBusCount();
+  NAU7802_Scheduler *getScheduler(uint8_t i2c_bus); //Scheduler owning /dev/i2c-N, or nullptr
+  NAU7802_WorkPool &getPool();
+
+private:
+  //Samples waiting for one device's stage. At most one pool task drains it at a time.
+  struct Strand
+  {
+    NAU7802_Stage stage;
+    std::mutex lock;
+    std::deque<NAU7802_Sample> pending;
+    bool scheduled;
+  };
+
+  struct Bus
+  {
+    uint8_t number;
+    NAU7802_Scheduler scheduler;
+    std::vector<Strand *> strands; //Indexed by scheduler slot
+    int producer; //Index in the output queue, -1 if none
+    std::thread thread;
+  };
+
+  void runBus(Bus *bus);
+  void dispatch(Strand *strand, const NAU7802_Sample &sample);
+  static void drain(Strand *strand);
+
+  std::vector<Bus *> buses;
+  NAU7802_WorkPool pool;
+  NAU7802_Queue *queue;
+  std::atomic<bool> running;
+};
+
+#endif
@@ -0,0 +1,51 @@
+/*
+  Sample record shared by the NAU7802 acquisition, queueing and filter code.
+
+  Timestamps are taken from the host steady clock in microseconds so that
+  samples coming from different devices (each with its own NAU7802 object)
+  can be compared and merged.
+*/
+
+#ifndef _NAU7802_Sample_h
+#define _NAU7802_Sample_h
+
+#include <stdint.h>
+#include <chrono>
+
+//One conversion result, tagged with where and when it came from
+struct NAU7802_Sample
+{
+  uint64_t timestamp_us; //Host steady clock at the time the conversion was read
+  int32_t value;         //Sign extended 24-bit ADC reading
+  uint16_t device;       //Caller assigned device tag
+  uint8_t channel;       //NAU7802_CHANNEL_1 or NAU7802_CHANNEL_2
+  uint8_t flags;         //NAU7802_FLAG_ bits, 0 for a clean conversion
+  uint32_t sequence;     //Per device read counter
+};
+
+//Sample quality flags. Filters and sinks pass them on; consumers decide what to drop.
+#define NAU7802_FLAG_SATURATED 0x01    //Reading at the +/-2^23 rails
+#define NAU7802_FLAG_SETTLING 0x02     //First conversion after a channel, gain or rate switch
+#define NAU7802_FLAG_RETRIED 0x04      //The I2C read failed once and was repeated
+#define NAU7802_FLAG_LATE 0x08         //Read after its deadline, the next conversion may have replaced it
+#define NAU7802_FLAG_CALIBRATING 0x10  //Taken while an AFE calibration was running
+#define NAU7802_FLAG_INTERPOLATED 0x20 //Computed by the resampler rather than converted
+
+#define NAU7802_READING_MAX 8388607    //2^23 - 1
+#define NAU7802_READING_MIN (-8388608) //-2^23
+
+//NAU7802_FLAG_SATURATED if a reading sits on a rail
+inline uint8_t NAU7802_saturation(int32_t value)
+{
+  return (value >= NAU7802_READING_MAX || value <= NAU7802_READING_MIN) ? NAU7802_FLAG_SATURATED : 0;
+}
+
+//Host steady clock in microseconds. Shared time base for all samples.
+inline uint64_t NAU7802_timestamp()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+#endif
@@ -0,0 +1,385 @@
+/*
+  Earliest deadline first transaction scheduler for the NAU7802s on one bus.
+  See NAU7802_Scheduler.h for the design.
+*/
+
+#include "NAU7802_Scheduler.h"
+
+#define NAU7802_CAL_POLL_INTERVAL_US 10000 //Calibration takes ~344ms, no need to poll faster
+
+NAU7802_Scheduler::NAU7802_Scheduler(uint32_t busClock_hz) : budget(busClock_hz)
+{
+}
+
+NAU7802_Scheduler::~NAU7802_Scheduler()
+{
+  for (size_t x = 0; x < devices.size(); x++)
+    delete devices[x].clock;
+}
+
+//Returns the device slot used by the other calls, or -1 if the bus has no room for it
+int NAU7802_Scheduler::addDevice(NAU7802 &device)
+{
+  if (budget.admitDevice(device.getSampleRate()) == false)
+    return (-1);
+
+  Device entry;
+  entry.device = &device;
+  entry.lastConversion_us = 0;
+  entry.readCount = 0;
+  entry.misses = 0;
+  entry.pollBackoff_us = 0;
+  entry.calibrating = false;
+  entry.nextCalPoll_us = 0;
+  entry.clock = new NAU7802_ClockEstimator(device.getConversionPeriod());
+  entry.reservedRate = device.getSampleRate();
+  entry.pendingRates = 0;
+  devices.push_back(entry);
+  return (devices.size() - 1);
+}
+
+uint8_t NAU7802_Scheduler::getDeviceCount()
+{
+  return (devices.size());
+}
+
+NAU7802 *NAU7802_Scheduler::getDevice(uint8_t slot)
+{
+  if (slot >= devices.size())
+    return (nullptr);
+  return (devices[slot].device);
+}
+
+//Queue a register write to run when no read is due
+void NAU7802_Scheduler::queueConfig(uint8_t slot, NAU7802_Config_Job job)
+{
+  Job entry;
+  entry.slot = slot;
+  entry.type = NAU7802_TXN_CONFIG;
+  entry.config = job;
+
+  std::lock_guard<std::mutex> guard(deferredLock);
+  deferred.push_back(entry);
+}
+
+//Queue an AFE calibration. Reads from this device pause until it completes.
+void NAU7802_Scheduler::queueCalibration(uint8_t slot, NAU7802_Cal_Done done)
+{
+  Job entry;
+  entry.slot = slot;
+  entry.type = NAU7802_TXN_CAL_POLL;
+  entry.calDone = done;
+
+  std::lock_guard<std::mutex> guard(deferredLock);
+  deferred.push_back(entry);
+}
+
+//Change a device's sample rate once the bus budget has room for it
+//Returns false, and leaves the device alone, if the new rate would oversubscribe the bus
+//The reservation moves now, against the rate reserved by any earlier queued change, and
+//moves back if the write fails.
+bool NAU7802_Scheduler::queueSampleRate(uint8_t slot, uint8_t rate)
+{
+  if (slot >= devices.size())
+    return (false);
+
+  std::lock_guard<std::mutex> guard(deferredLock);
+  Device &d = devices[slot];
+  uint8_t previous = d.reservedRate;
+  if (budget.admitRateChange(previous, rate) == false)
+    return (false);
+  d.reservedRate = rate;
+  d.pendingRates++;
+
+  Job entry;
+  entry.slot = slot;
+  entry.type = NAU7802_TXN_CONFIG;
+  entry.config = [this, slot, rate, previous](NAU7802 &device) {
+    bool result = device.setSampleRate(rate);
+    std::lock_guard<std::mutex> guard(deferredLock);
+    Device &d = devices[slot];
+    d.pendingRates--;
+    if (result == false && d.reservedRate == rate)
+    {
+      budget.moveDevice(rate, previous); //No later change took over the reservation
+      d.reservedRate = previous;
+    }
+    return (result);
+  };
+  deferred.push_back(entry);
+  return (true);
+}
+
+//Make the reservation follow a rate set directly with NAU7802::setSampleRate()
+//That can't be refused any more, but planned utilization stays honest.
+void NAU7802_Scheduler::followRate(Device &d)
+{
+  std::lock_guard<std::mutex> guard(deferredLock);
+  uint8_t rate = d.device->getSampleRate();
+  if (d.pendingRates > 0 || d.reservedRate == rate)
+    return; //Queued changes settle their own reservations
+  budget.moveDevice(d.reservedRate, rate);
+  d.reservedRate = rate;
+}
+
+//A new conversion should be waiting one period after the last one read. The first poll allows for
+//the poll and read themselves and then goes half a jitter allowance early: reads that always find
+//the conversion waiting can't tell the estimator its period is too long, and the schedule would
+//follow the estimate instead of the ADC.
+uint64_t NAU7802_Scheduler::readyTime(const Device &d)
+{
+  if (d.lastConversion_us == 0)
+    return (0);
+  double read = budget.getTransferTime(NAU7802_XFER_STATUS_POLL) + budget.getTransferTime(NAU7802_XFER_DATA_READ);
+  double ahead = read + d.clock->getJitterLimit() / 2;
+  if (ahead > d.clock->getPeriod() / 2)
+    ahead = d.clock->getPeriod() / 2;
+  return (d.lastConversion_us + (uint64_t)(d.clock->getPeriod() - ahead) + d.pollBackoff_us);
+}
+
+//The conversion after that overwrites it
+uint64_t NAU7802_Scheduler::deadline(const Device &d)
+{
+  if (d.lastConversion_us == 0)
+    return (0);
+  return (d.lastConversion_us + (uint64_t)(2 * d.clock->getPeriod()));
+}
+
+//Swap the earliest deadline read for one on the mux channel already enabled, if that can't make it miss
+int NAU7802_Scheduler::groupByChannel(int best, uint64_t now)
+{
+  NAU7802_Mux *mux = devices[best].device->getMux();
+  if (mux == nullptr || mux->getChannel() == NAU7802_MUX_NONE || mux->getChannel() == devices[best].device->getMuxChannel())
+    return (best);
+
+  //One read on this channel, then the switch and the urgent read
+  float read = budget.getTransferTime(NAU7802_XFER_STATUS_POLL) + budget.getTransferTime(NAU7802_XFER_DATA_READ);
+  if (now + 2 * read + budget.getTransferTime(NAU7802_XFER_MUX_SELECT) > deadline(devices[best]))
+    return (best);
+
+  int candidate = -1;
+  for (size_t x = 0; x < devices.size(); x++)
+  {
+    Device &d = devices[x];
+    if (d.calibrating || d.device->getMux() != mux || d.device->getMuxChannel() != mux->getChannel() || readyTime(d) > now)
+      continue;
+    if (candidate < 0 || deadline(d) < deadline(devices[candidate]))
+      candidate = x;
+  }
+  return (candidate >= 0 ? candidate : best);
+}
+
+//Poll and read one device. Returns true if a sample was read.
+bool NAU7802_Scheduler::runRead(uint8_t slot, uint64_t now, NAU7802_Sample &sample)
+{
+  Device &d = devices[slot];
+  uint32_t period = d.device->getConversionPeriod();
+
+  uint64_t start = NAU7802_timestamp();
+  bool ready = d.device->available();
+  uint64_t polled = NAU7802_timestamp();
+  budget.recordTransfer(NAU7802_XFER_STATUS_POLL, polled - start);
+
+  if (ready == false)
+  {
+    //Polled a little early, or the ADC oscillator runs slow against the host clock. Back off
+    //a fraction of a period instead of hammering the bus with status polls.
+    if (d.pollBackoff_us < period)
+      d.pollBackoff_us += period / 16;
+    return (false);
+  }
+
+  d.device->getReading();
+  budget.recordTransfer(NAU7802_XFER_DATA_READ, NAU7802_timestamp() - polled);
+  d.device->getLatest(sample);
+
+  //Replace the read time with the reconstructed conversion time
+  if (d.clock->getNominalPeriod() != period)
+  {
+    d.clock->reset(period); //Rate was changed
+    followRate(d);
+  }
+  if (d.lastConversion_us != 0 && now > deadline(d))
+    sample.flags |= NAU7802_FLAG_LATE;
+
+  //Conversions the estimator places between this read and the last are misses
+  uint64_t skipped = d.clock->getSkipped();
+  sample.timestamp_us = d.clock->update(sample.timestamp_us);
+  d.misses += d.clock->getSkipped() - skipped;
+
+  d.lastConversion_us = sample.timestamp_us;
+  d.pollBackoff_us = 0;
+  d.readCount++;
+  return (true);
+}
+
+//Run one deferred job or calibration poll if it fits before the next read is due
+//Returns true if a transaction was run
+bool NAU7802_Scheduler::runDeferred(uint64_t now, uint64_t nextReady)
+{
+  float cost = budget.getTransferTime(NAU7802_XFER_STATUS_POLL) + budget.getTransferTime(NAU7802_XFER_REGISTER_WRITE);
+  if (nextReady != 0 && now + cost > nextReady)
+    return (false); //Would push a read past its ready time
+
+  //Calibration polls first, they unblock reads
+  for (size_t x = 0; x < devices.size(); x++)
+  {
+    Device &d = devices[x];
+    if (d.calibrating == false || d.nextCalPoll_us > now)
+      continue;
+
+    NAU7802_Cal_Status status = d.device->calAFEStatus();
+    if (status == NAU7802_CAL_IN_PROGRESS)
+    {
+      d.nextCalPoll_us = now + NAU7802_CAL_POLL_INTERVAL_US;
+      return (true);
+    }
+
+    d.calibrating = false;
+    d.lastConversion_us = 0; //Conversion timing restarts after calibration
+    d.clock->reset(d.device->getConversionPeriod());
+    if (d.calDone)
+      d.calDone(*d.device, status);
+    return (true);
+  }
+
+  Job job;
+  {
+    std::lock_guard<std::mutex> guard(deferredLock);
+    if (deferred.empty())
+      return (false);
+    job = deferred.front();
+    deferred.pop_front();
+  }
+
+  if (job.slot >= devices.size())
+    return (false);
+
+  Device &d = devices[job.slot];
+  if (job.type == NAU7802_TXN_CONFIG)
+  {
+    job.config(*d.device);
+  }
+  else
+  {
+    d.device->beginCalibrateAFE();
+    d.calibrating = true;
+    d.calDone = job.calDone;
+    d.nextCalPoll_us = now + NAU7802_CAL_POLL_INTERVAL_US;
+  }
+  return (true);
+}
+
+//Run the most urgent transaction
+//Returns the slot of the device whose conversion was read into sample, or -1.
+//When -1 is returned idle_us holds how long until anything is due (0 to call again right away).
+int NAU7802_Scheduler::runNext(NAU7802_Sample &sample, uint32_t &idle_us)
+{
+  uint64_t now = NAU7802_timestamp();
+  idle_us = 0;
+
+  int best = -1;
+  uint64_t bestDeadline = 0;
+  uint64_t nextReady = 0;
+  for (size_t x = 0; x < devices.size(); x++)
+  {
+    Device &d = devices[x];
+    if (d.calibrating)
+      continue;
+
+    uint64_t ready = readyTime(d);
+    if (ready > now)
+    {
+      if (nextReady == 0 || ready < nextReady)
+        nextReady = ready;
+      continue;
+    }
+
+    if (best < 0 || deadline(d) < bestDeadline)
+    {
+      best = x;
+      bestDeadline = deadline(d);
+    }
+  }
+
+  if (best >= 0)
+  {
+    //Deferred work still gets a turn while reads are due back to back, as long as the read can wait for it
+    float read = budget.getTransferTime(NAU7802_XFER_STATUS_POLL) + budget.getTransferTime(NAU7802_XFER_DATA_READ);
+    if (bestDeadline > now + read && runDeferred(now, bestDeadline - (uint64_t)read))
+      return (-1);
+
+    best = groupByChannel(best, now);
+    if (runRead(best, now, sample))
+      return (best);
+
+    //Not converted yet; its ready time now includes the poll backoff
+    idle_us = idleTime(now);
+    return (-1);
+  }
+
+  if (runDeferred(now, nextReady))
+    return (-1);
+
+  idle_us = idleTime(now);
+  return (-1);
+}
+
+//Microseconds until the next read or calibration poll is due, 0 if one already is
+uint32_t NAU7802_Scheduler::idleTime(uint64_t now)
+{
+  uint64_t wake = 0;
+  for (size_t x = 0; x < devices.size(); x++)
+  {
+    uint64_t due = devices[x].calibrating ? devices[x].nextCalPoll_us : readyTime(devices[x]);
+    if (x == 0 || due < wake)
+      wake = due;
+  }
+  if (devices.size() == 0)
+    return (1000); //No devices
+  if (wake > now)
+    return (wake - now);
+  return (0);
+}
+
+uint64_t NAU7802_Scheduler::getReadCount(uint8_t slot)
+{
+  if (slot >= devices.size())
+    return (0);
+  return (devices[slot].readCount);
+}
+
+//Conversions that were overwritten before they could be read
+uint64_t NAU7802_Scheduler::getDeadlineMisses(uint8_t slot)
+{
+  if (slot >= devices.size())
+    return (0);
+  return (devices[slot].misses);
+}
+
+//Earliest read deadline across all devices, in steady clock microseconds
+uint64_t NAU7802_Scheduler::getEarliestDeadline()
+{
+  uint64_t earliest = 0;
+  for (size_t x = 0; x < devices.size(); x++)
+  {
+    uint64_t due = deadline(devices[x]);
+    if (x == 0 || due < earliest)
+      earliest = due;
+  }
+  return (earliest);
+}
+
+//Clock estimator for one device: true sample rate and drift against the host clock
+NAU7802_ClockEstimator *NAU7802_Scheduler::getClock(uint8_t slot)
+{
+  if (slot >= devices.size())
+    return (nullptr);
+  return (devices[slot].clock);
+}
+
+//Bandwidth model for this bus. Utilization and per-ioctl overhead are live.
+NAU7802_BusBudget &NAU7802_Scheduler::getBudget()
+{
+  return (budget);
+}
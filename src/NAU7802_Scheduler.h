@@ -0,0 +1,125 @@
+/*
+  Earliest deadline first transaction scheduler for the NAU7802s on one bus.
+
+  Every device produces a conversion each period (from its CRS rate) and the
+  next conversion overwrites the previous one. A read therefore becomes due
+  one period after the last conversion read and must happen before the
+  following conversion lands. Conversion times come from the device's clock
+  estimator, not from when the host got around to reading, so read latency
+  doesn't push the schedule later. Among due reads the scheduler always
+  serves the one closest to being overwritten. Configuration writes and
+  calibration polls have no deadline of their own; they only run in the
+  slack between reads, and are considered on every call so a bus kept busy
+  with reads can't starve them.
+
+  A conversion that was overwritten before it could be read is counted as a
+  deadline miss for that device. The clock estimator counts them from the
+  conversion timeline.
+
+  Every read also feeds a per-device clock estimator, and the sample handed
+  back carries the reconstructed conversion time instead of the jittery read
+  time.
+
+  Each scheduler carries the bus's bandwidth budget. Devices and rate
+  changes that would oversubscribe the bus are refused, and every poll and
+  read is timed to keep the budget's overhead estimate current. Change rates
+  through queueSampleRate(); a rate set directly on the device can't be
+  refused, and the budget only follows it at the next read.
+
+  Devices behind an I2C mux share the bus through one enabled channel at a
+  time. When the most urgent read sits on another channel, ready reads on the
+  enabled channel go first as long as the urgent one still makes its
+  deadline, so the mux switches once per group instead of once per read.
+
+  runNext() must be called from a single thread (the bus owner). Deferred
+  work may be queued from any thread.
+*/
+
+#ifndef _NAU7802_Scheduler_h
+#define _NAU7802_Scheduler_h
+
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "NAU7802.h"
+#include "NAU7802_BusBudget.h"
+#include "NAU7802_Clock.h"
+
+//Transaction kinds, most urgent first
+typedef enum
+{
+  NAU7802_TXN_READ = 0, //Fetch a pending conversion
+  NAU7802_TXN_CONFIG,   //Deferred register write
+  NAU7802_TXN_CAL_POLL, //Check on an asynchronous AFE calibration
+} NAU7802_Transaction_Type;
+
+//Deferred configuration. Runs on the bus thread with exclusive access to the device.
+typedef std::function<bool(NAU7802 &)> NAU7802_Config_Job;
+
+//Called on the bus thread once a calibration started with queueCalibration() finishes
+typedef std::function<void(NAU7802 &, NAU7802_Cal_Status)> NAU7802_Cal_Done;
+
+class NAU7802_Scheduler
+{
+public:
+  NAU7802_Scheduler(uint32_t busClock_hz = 100000);
+  ~NAU7802_Scheduler();
+
+  int addDevice(NAU7802 &device); //Returns the device slot, or -1 if the bus budget can't fit it
+  uint8_t getDeviceCount();
+  NAU7802 *getDevice(uint8_t slot);
+
+  void queueConfig(uint8_t slot, NAU7802_Config_Job job);   //Safe from any thread
+  void queueCalibration(uint8_t slot, NAU7802_Cal_Done done); //Start AFE calibration and poll it in the slack. Safe from any thread.
+  bool queueSampleRate(uint8_t slot, uint8_t rate);           //Change rate if the bus budget allows it. Safe from any thread.
+
+  int runNext(NAU7802_Sample &sample, uint32_t &idle_us); //Run one transaction. Returns the slot whose sample was read, else -1 and how long nothing is due (sleep that long)
+
+  uint64_t getReadCount(uint8_t slot);
+  uint64_t getDeadlineMisses(uint8_t slot); //Conversions overwritten before they were read
+  uint64_t getEarliestDeadline();           //Steady clock microseconds, 0 if no device
+  NAU7802_BusBudget &getBudget();
+  NAU7802_ClockEstimator *getClock(uint8_t slot); //True sample rate and drift of one device
+
+private:
+  struct Device
+  {
+    NAU7802 *device;
+    uint64_t lastConversion_us; //Reconstructed time of the last conversion read, 0 until the first read
+    uint64_t readCount;
+    uint64_t misses;
+    uint32_t pollBackoff_us; //Added when a read was due but the conversion wasn't ready yet
+    bool calibrating;
+    NAU7802_Cal_Done calDone;
+    uint64_t nextCalPoll_us;
+    NAU7802_ClockEstimator *clock;
+    uint8_t reservedRate; //Rate the bus budget holds for this device. Guarded by deferredLock
+    uint8_t pendingRates; //Queued rate changes not yet run. Guarded by deferredLock
+  };
+
+  struct Job
+  {
+    uint8_t slot;
+    NAU7802_Transaction_Type type;
+    NAU7802_Config_Job config;
+    NAU7802_Cal_Done calDone;
+  };
+
+  uint64_t readyTime(const Device &d);
+  uint64_t deadline(const Device &d);
+  int groupByChannel(int best, uint64_t now);
+  bool runRead(uint8_t slot, uint64_t now, NAU7802_Sample &sample);
+  bool runDeferred(uint64_t now, uint64_t nextReady);
+  uint32_t idleTime(uint64_t now);
+  void followRate(Device &d);
+
+  std::vector<Device> devices;
+  std::deque<Job> deferred;
+  std::mutex deferredLock;
+  NAU7802_BusBudget budget;
+};
+
+#endif
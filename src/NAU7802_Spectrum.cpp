@@ -0,0 +1,445 @@
+/*
+  Vibration spectrum analysis and automatic notch filtering for NAU7802 streams.
+  See NAU7802_Spectrum.h for the design.
+*/
+
+#include "NAU7802_Spectrum.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+NAU7802_Notch::NAU7802_Notch()
+{
+  disable();
+}
+
+//Band stop centered on frequency_hz. Bandwidth is frequency / q.
+void NAU7802_Notch::configure(float frequency_hz, float sampleRate_hz, float q)
+{
+  if (frequency_hz <= 0 || frequency_hz >= sampleRate_hz / 2 || q <= 0)
+  {
+    disable();
+    return;
+  }
+
+  float w0 = 2 * M_PI * frequency_hz / sampleRate_hz;
+  float alpha = sinf(w0) / (2 * q);
+  float a0 = 1 + alpha;
+
+  b0 = 1 / a0;
+  b1 = -2 * cosf(w0) / a0;
+  b2 = 1 / a0;
+  a1 = -2 * cosf(w0) / a0;
+  a2 = (1 - alpha) / a0;
+  frequency = frequency_hz;
+  this->q = q;
+  enabled = true;
+  //Keep the state so retuning a running filter doesn't kick the output
+}
+
+void NAU7802_Notch::disable()
+{
+  enabled = false;
+  frequency = 0;
+  q = 0;
+  b0 = 1;
+  b1 = b2 = a1 = a2 = 0;
+  z1 = z2 = 0;
+}
+
+bool NAU7802_Notch::isEnabled()
+{
+  return (enabled);
+}
+
+float NAU7802_Notch::getFrequency()
+{
+  return (frequency);
+}
+
+float NAU7802_Notch::getQ()
+{
+  return (q);
+}
+
+float NAU7802_Notch::process(float x)
+{
+  if (enabled == false)
+    return (x);
+
+  float y = b0 * x + z1;
+  z1 = b1 * x - a1 * y + z2;
+  z2 = b2 * x - a2 * y;
+  return (y);
+}
+
+NAU7802_NotchBank::NAU7802_NotchBank(float sampleRate_hz)
+{
+  sampleRate = sampleRate_hz;
+  pendingValid = false;
+  for (uint8_t x = 0; x < NAU7802_MAX_NOTCHES; x++)
+  {
+    pendingFrequency[x] = 0;
+    pendingQ[x] = 0;
+    activeFrequency[x] = 0;
+  }
+}
+
+//Stage a notch. The processing thread applies it before its next sample.
+void NAU7802_NotchBank::setNotch(uint8_t index, float frequency_hz, float q)
+{
+  if (index >= NAU7802_MAX_NOTCHES)
+    return;
+
+  std::lock_guard<std::mutex> guard(pendingLock);
+  pendingFrequency[index] = frequency_hz;
+  pendingQ[index] = q;
+  pendingValid.store(true, std::memory_order_release);
+}
+
+void NAU7802_NotchBank::clearNotch(uint8_t index)
+{
+  setNotch(index, 0, 0);
+}
+
+float NAU7802_NotchBank::getFrequency(uint8_t index)
+{
+  if (index >= NAU7802_MAX_NOTCHES)
+    return (0);
+  return (activeFrequency[index].load(std::memory_order_relaxed));
+}
+
+void NAU7802_NotchBank::applyPending()
+{
+  std::lock_guard<std::mutex> guard(pendingLock);
+  for (uint8_t x = 0; x < NAU7802_MAX_NOTCHES; x++)
+  {
+    if (pendingFrequency[x] == notches[x].getFrequency() && (pendingFrequency[x] <= 0 || pendingQ[x] == notches[x].getQ()))
+      continue;
+    if (pendingFrequency[x] > 0)
+      notches[x].configure(pendingFrequency[x], sampleRate, pendingQ[x]);
+    else
+      notches[x].disable();
+    activeFrequency[x].store(notches[x].getFrequency(), std::memory_order_relaxed);
+  }
+  pendingValid.store(false, std::memory_order_relaxed);
+}
+
+float NAU7802_NotchBank::process(float x)
+{
+  if (pendingValid.load(std::memory_order_acquire))
+    applyPending();
+
+  for (uint8_t n = 0; n < NAU7802_MAX_NOTCHES; n++)
+    x = notches[n].process(x);
+  return (x);
+}
+
+NAU7802_Sample NAU7802_NotchBank::process(const NAU7802_Sample &sample)
+{
+  NAU7802_Sample filtered = sample;
+  filtered.value = (int32_t)lrintf(process((float)sample.value));
+  return (filtered);
+}
+
+NAU7802_Spectrum::NAU7802_Spectrum(float sampleRate_hz, uint16_t fftSize, uint8_t averages)
+{
+  sampleRate = sampleRate_hz;
+  this->averages = averages < 1 ? 1 : averages;
+
+  size = 8;
+  log2Size = 3;
+  while (size < fftSize && size < 32768)
+  {
+    size <<= 1;
+    log2Size++;
+  }
+
+  ringSize = 4 * size;
+  ring = new float[ringSize];
+  written = 0;
+  consumed = 0;
+  dropped = 0;
+
+  //Hann window and its power for PSD scaling
+  window = new float[size];
+  windowPower = 0;
+  for (uint16_t x = 0; x < size; x++)
+  {
+    window[x] = 0.5f - 0.5f * cosf(2 * M_PI * x / size);
+    windowPower += window[x] * window[x];
+  }
+
+  bitReverse = new uint16_t[size];
+  for (uint16_t x = 0; x < size; x++)
+  {
+    uint16_t reversed = 0;
+    for (uint8_t bit = 0; bit < log2Size; bit++)
+    {
+      if (x & (1 << bit))
+        reversed |= 1 << (log2Size - 1 - bit);
+    }
+    bitReverse[x] = reversed;
+  }
+
+  //Twiddles laid out per stage so each stage's butterflies read them contiguously.
+  //The stage with half length h uses entries h-1 .. 2h-2.
+  twiddleRe = new float[size];
+  twiddleIm = new float[size];
+  for (uint16_t half = 1; half < size; half <<= 1)
+  {
+    for (uint16_t k = 0; k < half; k++)
+    {
+      twiddleRe[half - 1 + k] = cosf(M_PI * k / half);
+      twiddleIm[half - 1 + k] = -sinf(M_PI * k / half);
+    }
+  }
+
+  re = new float[size];
+  im = new float[size];
+  accumulator = new float[size / 2];
+  psd = new float[size / 2];
+  memset(accumulator, 0, sizeof(float) * size / 2);
+  memset(psd, 0, sizeof(float) * size / 2);
+  accumulated = 0;
+
+  peakCount = 0;
+  estimates = 0;
+  minFrequency = 2;
+  minProminence = 10;
+  maxPeaks = NAU7802_MAX_NOTCHES;
+  bank = nullptr;
+  bandwidth = 0;
+}
+
+NAU7802_Spectrum::~NAU7802_Spectrum()
+{
+  delete[] ring;
+  delete[] window;
+  delete[] bitReverse;
+  delete[] twiddleRe;
+  delete[] twiddleIm;
+  delete[] re;
+  delete[] im;
+  delete[] accumulator;
+  delete[] psd;
+}
+
+//Only consider peaks above minFrequency_hz standing minProminence times above the median floor
+void NAU7802_Spectrum::setPeakDetection(float minFrequency_hz, float prominence, uint8_t peaks)
+{
+  std::lock_guard<std::mutex> guard(resultLock);
+  minFrequency = minFrequency_hz;
+  minProminence = prominence;
+  maxPeaks = peaks > NAU7802_MAX_NOTCHES ? NAU7802_MAX_NOTCHES : peaks;
+}
+
+//Retune bank onto the detected peaks after every finished estimate
+void NAU7802_Spectrum::autoTune(NAU7802_NotchBank *notchBank, float bandwidth_hz)
+{
+  std::lock_guard<std::mutex> guard(resultLock);
+  bank = notchBank;
+  bandwidth = bandwidth_hz;
+}
+
+//Producer side: queue one sample for analysis
+void NAU7802_Spectrum::feed(const NAU7802_Sample &sample)
+{
+  uint64_t head = written.load(std::memory_order_relaxed);
+  if (head - consumed.load(std::memory_order_acquire) >= ringSize)
+  {
+    dropped.fetch_add(1, std::memory_order_relaxed); //Analysis fell behind; never overwrite unread input
+    return;
+  }
+  ring[head % ringSize] = (float)sample.value;
+  written.store(head + 1, std::memory_order_release);
+}
+
+//In place radix-2 decimation in time FFT on split real/imaginary arrays
+void NAU7802_Spectrum::fft(float *real, float *imag)
+{
+  for (uint16_t x = 0; x < size; x++)
+  {
+    uint16_t y = bitReverse[x];
+    if (y > x)
+    {
+      std::swap(real[x], real[y]);
+      std::swap(imag[x], imag[y]);
+    }
+  }
+
+  for (uint16_t half = 1; half < size; half <<= 1)
+  {
+    const float *wr = &twiddleRe[half - 1];
+    const float *wi = &twiddleIm[half - 1];
+    for (uint16_t start = 0; start < size; start += 2 * half)
+    {
+      float *__restrict ar = &real[start];
+      float *__restrict ai = &imag[start];
+      float *__restrict br = &real[start + half];
+      float *__restrict bi = &imag[start + half];
+      //Unit stride over butterflies and twiddles so the compiler can vectorize
+      for (uint16_t k = 0; k < half; k++)
+      {
+        float tr = br[k] * wr[k] - bi[k] * wi[k];
+        float ti = br[k] * wi[k] + bi[k] * wr[k];
+        br[k] = ar[k] - tr;
+        bi[k] = ai[k] - ti;
+        ar[k] += tr;
+        ai[k] += ti;
+      }
+    }
+  }
+}
+
+//Average is complete: publish the PSD, find peaks and retune the notch bank
+void NAU7802_Spectrum::finishEstimate()
+{
+  uint16_t bins = size / 2;
+  float binWidth = sampleRate / size;
+
+  std::lock_guard<std::mutex> guard(resultLock);
+  for (uint16_t x = 0; x < bins; x++)
+    psd[x] = accumulator[x] / accumulated;
+  memset(accumulator, 0, sizeof(float) * bins);
+  accumulated = 0;
+  estimates++;
+
+  //Median noise floor, using the (now free) FFT buffer as scratch
+  memcpy(re, psd, sizeof(float) * bins);
+  std::nth_element(re, re + bins / 2, re + bins);
+  float floor = re[bins / 2];
+  if (floor <= 0)
+    floor = 1E-12;
+
+  uint16_t firstBin = (uint16_t)ceilf(minFrequency / binWidth);
+  if (firstBin < 2)
+    firstBin = 2; //Bins near DC are the load itself
+
+  peakCount = 0;
+  for (uint16_t x = firstBin; x + 1 < bins; x++)
+  {
+    if (psd[x] <= psd[x - 1] || psd[x] < psd[x + 1] || psd[x] < floor * minProminence)
+      continue;
+
+    //Parabolic interpolation on log power for a sub-bin frequency
+    float l = logf(psd[x - 1] + 1E-20f), c = logf(psd[x]), r = logf(psd[x + 1] + 1E-20f);
+    float curve = l - 2 * c + r;
+    float offset = (curve < 0) ? 0.5f * (l - r) / curve : 0;
+
+    NAU7802_Peak peak;
+    peak.frequency_hz = (x + offset) * binWidth;
+    peak.power = psd[x];
+    peak.prominence = psd[x] / floor;
+
+    //Keep the strongest maxPeaks, sorted strongest first
+    uint8_t slot = peakCount;
+    while (slot > 0 && peaks[slot - 1].power < peak.power)
+    {
+      if (slot < maxPeaks)
+        peaks[slot] = peaks[slot - 1];
+      slot--;
+    }
+    if (slot < maxPeaks)
+    {
+      peaks[slot] = peak;
+      if (peakCount < maxPeaks)
+        peakCount++;
+    }
+  }
+
+  if (bank == nullptr)
+    return;
+
+  float width = bandwidth > 0 ? bandwidth : 2 * binWidth;
+  for (uint8_t x = 0; x < NAU7802_MAX_NOTCHES; x++)
+  {
+    if (x >= peakCount)
+    {
+      if (bank->getFrequency(x) != 0)
+        bank->clearNotch(x);
+      continue;
+    }
+    //Only retune when the peak has really moved, so the filter isn't disturbed every estimate
+    if (fabsf(bank->getFrequency(x) - peaks[x].frequency_hz) > binWidth / 2)
+      bank->setNotch(x, peaks[x].frequency_hz, peaks[x].frequency_hz / width);
+  }
+}
+
+//Consumer side: run FFT segments until input or time runs out
+//Returns the number of segments processed
+uint8_t NAU7802_Spectrum::process(uint32_t budget_us)
+{
+  uint64_t start = NAU7802_timestamp();
+  uint8_t segments = 0;
+  uint16_t hop = size / 2; //50% overlap
+
+  uint64_t first = consumed.load(std::memory_order_relaxed); //Only this thread moves it
+  while (written.load(std::memory_order_acquire) - first >= size)
+  {
+    //Remove the segment mean so the load itself doesn't leak into low bins
+    float mean = 0;
+    for (uint16_t x = 0; x < size; x++)
+      mean += ring[(first + x) % ringSize];
+    mean /= size;
+
+    for (uint16_t x = 0; x < size; x++)
+    {
+      re[x] = (ring[(first + x) % ringSize] - mean) * window[x];
+      im[x] = 0;
+    }
+    first += hop;
+    consumed.store(first, std::memory_order_release); //Hand the oldest half back to feed()
+
+    fft(re, im);
+
+    float scale = 2.0f / (sampleRate * windowPower); //One sided PSD
+    for (uint16_t x = 0; x < size / 2; x++)
+      accumulator[x] += (re[x] * re[x] + im[x] * im[x]) * scale;
+    segments++;
+
+    if (++accumulated >= averages)
+      finishEstimate();
+
+    if (NAU7802_timestamp() - start >= budget_us)
+      break;
+  }
+  return (segments);
+}
+
+uint8_t NAU7802_Spectrum::getPeaks(NAU7802_Peak *out, uint8_t maxOut)
+{
+  std::lock_guard<std::mutex> guard(resultLock);
+  uint8_t count = peakCount < maxOut ? peakCount : maxOut;
+  for (uint8_t x = 0; x < count; x++)
+    out[x] = peaks[x];
+  return (count);
+}
+
+bool NAU7802_Spectrum::getSpectrum(float *out, uint16_t bins)
+{
+  std::lock_guard<std::mutex> guard(resultLock);
+  if (estimates == 0)
+    return (false);
+  if (bins > size / 2)
+    bins = size / 2;
+  memcpy(out, psd, sizeof(float) * bins);
+  return (true);
+}
+
+float NAU7802_Spectrum::getBinWidth()
+{
+  return (sampleRate / size);
+}
+
+uint32_t NAU7802_Spectrum::getEstimateCount()
+{
+  std::lock_guard<std::mutex> guard(resultLock);
+  return (estimates);
+}
+
+uint64_t NAU7802_Spectrum::getDroppedCount()
+{
+  return (dropped.load(std::memory_order_relaxed));
+}
@@ -0,0 +1,138 @@
+/*
+  Vibration spectrum analysis and automatic notch filtering for NAU7802 streams.
+
+  NAU7802_Notch is a biquad band stop filter. NAU7802_NotchBank chains a few
+  of them as a pipeline stage; it can be retuned from another thread and
+  picks up the new coefficients between samples.
+
+  NAU7802_Spectrum estimates a device's power spectrum with Welch's method:
+  Hann windowed, 50% overlapped segments through a radix-2 FFT, averaged. It
+  finds interference peaks standing well above the median noise floor and
+  can retune a notch bank onto them. Feeding samples is cheap and done on
+  the acquisition side; the FFT work happens in process(), which runs on any
+  background thread under a time budget so it can't starve acquisition.
+*/
+
+#ifndef _NAU7802_Spectrum_h
+#define _NAU7802_Spectrum_h
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+
+#include "NAU7802_Sample.h"
+
+#define NAU7802_MAX_NOTCHES 4
+
+//One band stop biquad (RBJ cookbook notch)
+class NAU7802_Notch
+{
+public:
+  NAU7802_Notch();
+
+  void configure(float frequency_hz, float sampleRate_hz, float q);
+  void disable();
+  bool isEnabled();
+  float getFrequency();
+  float getQ();
+  float process(float x);
+
+private:
+  bool enabled;
+  float frequency;
+  float q;
+  float b0, b1, b2, a1, a2;
+  float z1, z2; //Transposed direct form II state
+};
+
+//Chain of notches usable as a pipeline stage
+class NAU7802_NotchBank
+{
+public:
+  NAU7802_NotchBank(float sampleRate_hz);
+
+  void setNotch(uint8_t index, float frequency_hz, float q); //Safe from any thread. Applied before the next sample
+  void clearNotch(uint8_t index);                            //Safe from any thread
+  float getFrequency(uint8_t index);                         //0 if that notch is off
+
+  float process(float x);
+  NAU7802_Sample process(const NAU7802_Sample &sample); //Keeps the sample's tags
+
+private:
+  void applyPending();
+
+  float sampleRate;
+  NAU7802_Notch notches[NAU7802_MAX_NOTCHES];
+
+  std::mutex pendingLock;
+  std::atomic<bool> pendingValid;
+  float pendingFrequency[NAU7802_MAX_NOTCHES]; //0 turns a notch off
+  float pendingQ[NAU7802_MAX_NOTCHES];
+  std::atomic<float> activeFrequency[NAU7802_MAX_NOTCHES];
+};
+
+//One spectral peak
+struct NAU7802_Peak
+{
+  float frequency_hz;
+  float power; //Averaged power spectral density at the peak, counts squared per bin
+  float prominence; //Peak power over the median noise floor
+};
+
+class NAU7802_Spectrum
+{
+public:
+  NAU7802_Spectrum(float sampleRate_hz, uint16_t fftSize = 256, uint8_t averages = 8); //fftSize is rounded up to a power of two
+  ~NAU7802_Spectrum();
+
+  void feed(const NAU7802_Sample &sample); //Producer side. Constant time, drops samples if process() falls far behind
+  uint8_t process(uint32_t budget_us);     //Consumer side. Runs FFT segments until out of data or time. Returns segments done
+
+  void setPeakDetection(float minFrequency_hz, float minProminence = 10, uint8_t maxPeaks = NAU7802_MAX_NOTCHES);
+  void autoTune(NAU7802_NotchBank *bank, float bandwidth_hz = 0); //Retune this bank after every finished estimate. 0 bandwidth picks two bins
+
+  uint8_t getPeaks(NAU7802_Peak *out, uint8_t maxPeaks); //Peaks from the last finished estimate
+  bool getSpectrum(float *out, uint16_t bins);           //Last finished PSD, fftSize/2 bins
+  float getBinWidth();                                   //Hz per bin
+  uint32_t getEstimateCount();                           //Finished Welch estimates
+  uint64_t getDroppedCount();                            //Samples lost because process() fell behind
+
+private:
+  void fft(float *re, float *im);
+  void finishEstimate();
+
+  float sampleRate;
+  uint16_t size;
+  uint8_t log2Size;
+  uint8_t averages;
+
+  //Input ring shared by feed() and process()
+  float *ring;
+  uint32_t ringSize;
+  std::atomic<uint64_t> written;
+  std::atomic<uint64_t> consumed; //Start of the next segment
+  std::atomic<uint64_t> dropped;
+
+  float *window;
+  uint16_t *bitReverse;
+  float *twiddleRe; //size/2 twiddles, e^(-2 pi i k / size)
+  float *twiddleIm;
+  float *re;
+  float *im;
+  float *accumulator;
+  uint8_t accumulated;
+  float windowPower;
+
+  std::mutex resultLock; //Guards everything below
+  float *psd;
+  NAU7802_Peak peaks[NAU7802_MAX_NOTCHES];
+  uint8_t peakCount;
+  uint32_t estimates;
+  float minFrequency;
+  float minProminence;
+  uint8_t maxPeaks;
+  NAU7802_NotchBank *bank;
+  float bandwidth;
+};
+
+#endif
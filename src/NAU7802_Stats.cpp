@@ -0,0 +1,353 @@
+/*
+  Streaming statistics for NAU7802 readings.
+  See NAU7802_Stats.h for the design.
+*/
+
+#include "NAU7802_Stats.h"
+
+static const uint64_t bucketWidth_us[NAU7802_ROLLUP_LEVELS] = {
+    1000000ULL,
+    60 * 1000000ULL,
+    3600 * 1000000ULL,
+};
+
+NAU7802_Rollup::NAU7802_Rollup(uint16_t seconds, uint16_t minutes, uint16_t hours)
+{
+  capacity[NAU7802_ROLLUP_SECOND] = seconds;
+  capacity[NAU7802_ROLLUP_MINUTE] = minutes;
+  capacity[NAU7802_ROLLUP_HOUR] = hours;
+
+  for (uint8_t level = 0; level < NAU7802_ROLLUP_LEVELS; level++)
+  {
+    if (capacity[level] == 0)
+      capacity[level] = 1; //The open bucket needs a slot
+    rings[level] = new NAU7802_Rollup_Bucket[capacity[level]];
+  }
+  clear();
+}
+
+NAU7802_Rollup::~NAU7802_Rollup()
+{
+  for (uint8_t level = 0; level < NAU7802_ROLLUP_LEVELS; level++)
+    delete[] rings[level];
+}
+
+void NAU7802_Rollup::clear()
+{
+  for (uint8_t level = 0; level < NAU7802_ROLLUP_LEVELS; level++)
+  {
+    head[level] = 0;
+    filled[level] = 0;
+    index[level] = 0;
+  }
+}
+
+//Hand a finished bucket's statistics to the parent resolution
+void NAU7802_Rollup::close(uint8_t level)
+{
+  if (level + 1 >= NAU7802_ROLLUP_LEVELS)
+    return;
+
+  NAU7802_Rollup_Bucket &done = rings[level][head[level]];
+  open(level + 1, done.start_us / bucketWidth_us[level + 1]);
+  rings[level + 1][head[level + 1]].stats.merge(done.stats);
+}
+
+//Make the bucket with this index the open one, closing the previous one
+void NAU7802_Rollup::open(uint8_t level, uint64_t newIndex)
+{
+  if (filled[level] > 0)
+  {
+    if (index[level] == newIndex)
+      return; //Already open
+    close(level);
+    head[level] = (head[level] + 1) % capacity[level];
+  }
+  if (filled[level] < capacity[level])
+    filled[level]++;
+
+  index[level] = newIndex;
+  NAU7802_Rollup_Bucket &bucket = rings[level][head[level]];
+  bucket.start_us = newIndex * bucketWidth_us[level];
+  bucket.stats.clear();
+}
+
+//Fold one sample into the open 1 second bucket
+void NAU7802_Rollup::add(const NAU7802_Sample &sample)
+{
+  uint64_t second = sample.timestamp_us / bucketWidth_us[NAU7802_ROLLUP_SECOND];
+  if (filled[NAU7802_ROLLUP_SECOND] > 0 && second < index[NAU7802_ROLLUP_SECOND])
+    second = index[NAU7802_ROLLUP_SECOND]; //Late sample, count it in the open bucket
+
+  open(NAU7802_ROLLUP_SECOND, second);
+  rings[NAU7802_ROLLUP_SECOND][head[NAU7802_ROLLUP_SECOND]].stats.add(sample.value);
+}
+
+uint16_t NAU7802_Rollup::getBucketCount(NAU7802_Rollup_Level level)
+{
+  if (level >= NAU7802_ROLLUP_LEVELS)
+    return (0);
+  return (filled[level]);
+}
+
+//Copy out a bucket. Age 0 is the open bucket, 1 the one before it, and so on.
+//The open bucket of a coarse level includes the still open buckets below it.
+//Returns false if no bucket of that age is held.
+bool NAU7802_Rollup::getBucket(NAU7802_Rollup_Level level, uint16_t age, NAU7802_Rollup_Bucket &out)
+{
+  if (level >= NAU7802_ROLLUP_LEVELS || age >= filled[level])
+    return (false);
+
+  out = rings[level][(head[level] + capacity[level] - age) % capacity[level]];
+  if (age == 0)
+  {
+    //Children still open belong to this bucket unless they already started a newer one
+    for (int lower = level - 1; lower >= 0; lower--)
+    {
+      if (filled[lower] == 0)
+        continue;
+      const NAU7802_Rollup_Bucket &child = rings[lower][head[lower]];
+      if (child.start_us / bucketWidth_us[level] == index[level])
+        out.stats.merge(child.stats);
+    }
+  }
+  return (true);
+}
+
+//Merge every held bucket at this resolution whose start falls in [from_us, to_us)
+//Returns false if there were none
+bool NAU7802_Rollup::summarize(NAU7802_Rollup_Level level, uint64_t from_us, uint64_t to_us, NAU7802_Welford &out)
+{
+  out.clear();
+  if (level >= NAU7802_ROLLUP_LEVELS)
+    return (false);
+
+  NAU7802_Rollup_Bucket bucket;
+  bool found = false;
+  for (uint16_t age = 0; age < filled[level]; age++)
+  {
+    getBucket(level, age, bucket);
+    if (bucket.start_us >= from_us && bucket.start_us < to_us)
+    {
+      out.merge(bucket.stats);
+      found = true;
+    }
+  }
+  return (found);
+}
+
+NAU7802_SlidingStats::NAU7802_SlidingStats(uint32_t windowLength)
+{
+  window = windowLength < 1 ? 1 : windowLength;
+  values = new double[window];
+  minQueue = new uint64_t[window];
+  maxQueue = new uint64_t[window];
+  clear();
+}
+
+NAU7802_SlidingStats::~NAU7802_SlidingStats()
+{
+  delete[] values;
+  delete[] minQueue;
+  delete[] maxQueue;
+}
+
+void NAU7802_SlidingStats::clear()
+{
+  count = 0;
+  next = 0;
+  sinceRecenter = 0;
+  shift = 0;
+  s1 = s2 = s3 = 0;
+  minHead = minCount = 0;
+  maxHead = maxCount = 0;
+  added = 0;
+}
+
+uint32_t NAU7802_SlidingStats::getWindow()
+{
+  return (window);
+}
+
+//Rebuild the power sums around the current mean. Runs once per window, so add() stays constant time amortized.
+void NAU7802_SlidingStats::recenter()
+{
+  double mean = (count > 0) ? shift + s1 / count : 0;
+  shift = mean;
+  s1 = s2 = s3 = 0;
+  for (uint32_t x = 0; x < count; x++)
+  {
+    double d = values[(next + window - count + x) % window] - shift;
+    s1 += d;
+    s2 += d * d;
+    s3 += d * d * d;
+  }
+  sinceRecenter = 0;
+}
+
+void NAU7802_SlidingStats::add(double x)
+{
+  if (count == 0)
+    shift = x;
+
+  //Drop the oldest sample once the window is full
+  if (count == window)
+  {
+    double d = values[next] - shift;
+    s1 -= d;
+    s2 -= d * d;
+    s3 -= d * d * d;
+    count--;
+  }
+
+  values[next] = x;
+  double d = x - shift;
+  s1 += d;
+  s2 += d * d;
+  s3 += d * d * d;
+  count++;
+
+  //Queues hold sample numbers; anything older than the window falls off the front
+  uint64_t oldest = (added + 1 > window) ? added + 1 - window : 0;
+  while (minCount > 0 && minQueue[minHead] < oldest)
+  {
+    minHead = (minHead + 1) % window;
+    minCount--;
+  }
+  while (maxCount > 0 && maxQueue[maxHead] < oldest)
+  {
+    maxHead = (maxHead + 1) % window;
+    maxCount--;
+  }
+
+  //Newer samples beat older ones that can no longer be the min or max
+  while (minCount > 0 && values[minQueue[(minHead + minCount - 1) % window] % window] >= x)
+    minCount--;
+  while (maxCount > 0 && values[maxQueue[(maxHead + maxCount - 1) % window] % window] <= x)
+    maxCount--;
+  minQueue[(minHead + minCount) % window] = added;
+  minCount++;
+  maxQueue[(maxHead + maxCount) % window] = added;
+  maxCount++;
+
+  added++;
+  next = (next + 1) % window;
+  if (++sinceRecenter >= window)
+    recenter();
+}
+
+//Statistics of the samples currently in the window, in the same form as a running total
+NAU7802_Welford NAU7802_SlidingStats::getStats()
+{
+  NAU7802_Welford stats;
+  stats.clear();
+  if (count == 0)
+    return (stats);
+
+  double n = count;
+  double mean = s1 / n; //Relative to shift
+  stats.count = count;
+  stats.mean = shift + mean;
+  stats.m2 = s2 - n * mean * mean;
+  if (stats.m2 < 0)
+    stats.m2 = 0; //Rounding
+  stats.m3 = s3 - 3 * mean * s2 + 2 * n * mean * mean * mean;
+  stats.min = values[minQueue[minHead] % window];
+  stats.max = values[maxQueue[maxHead] % window];
+  return (stats);
+}
+
+NAU7802_TumblingStats::NAU7802_TumblingStats(uint32_t blockSamples, uint64_t blockDuration_us)
+{
+  samples = blockSamples;
+  duration_us = blockDuration_us;
+  last.clear();
+  lastStart_us = 0;
+  blocks = 0;
+  clear();
+}
+
+void NAU7802_TumblingStats::clear()
+{
+  current.clear();
+  start_us = 0;
+}
+
+//Fold in a sample. When it fills the block, the block becomes getLast() and a new one starts.
+bool NAU7802_TumblingStats::add(const NAU7802_Sample &sample)
+{
+  bool closed = false;
+
+  //A duration block closes when a sample arrives past its end; that sample starts the next block
+  if (duration_us > 0 && current.count > 0 && sample.timestamp_us - start_us >= duration_us)
+  {
+    last = current;
+    lastStart_us = start_us;
+    blocks++;
+    current.clear();
+    closed = true;
+  }
+
+  if (current.count == 0)
+    start_us = sample.timestamp_us;
+  current.add(sample.value);
+
+  if (samples > 0 && current.count >= samples)
+  {
+    last = current;
+    lastStart_us = start_us;
+    blocks++;
+    current.clear();
+    closed = true;
+  }
+  return (closed);
+}
+
+NAU7802_Welford NAU7802_TumblingStats::getCurrent()
+{
+  return (current);
+}
+
+NAU7802_Welford NAU7802_TumblingStats::getLast()
+{
+  return (last);
+}
+
+uint64_t NAU7802_TumblingStats::getLastStart()
+{
+  return (lastStart_us);
+}
+
+uint32_t NAU7802_TumblingStats::getBlockCount()
+{
+  return (blocks);
+}
+
+NAU7802_DeviceStats::NAU7802_DeviceStats(uint32_t slidingWindow, uint32_t tumblingSamples, uint64_t tumblingDuration_us)
+    : sliding(slidingWindow), tumbling(tumblingSamples, tumblingDuration_us)
+{
+  rejectMask = 0;
+  rejected = 0;
+  total.clear();
+}
+
+bool NAU7802_DeviceStats::add(const NAU7802_Sample &sample)
+{
+  if (sample.flags & rejectMask)
+  {
+    rejected++;
+    return (false);
+  }
+
+  total.add(sample.value);
+  sliding.add(sample.value);
+  return (tumbling.add(sample));
+}
+
+void NAU7802_DeviceStats::clear()
+{
+  rejected = 0;
+  total.clear();
+  sliding.clear();
+  tumbling.clear();
+}
@@ -0,0 +1,210 @@
+/*
+  Streaming statistics for NAU7802 readings.
+
+  NAU7802_Welford keeps count, mean, variance, skewness, min and max in a
+  single pass with Welford's update, and two of them can be merged exactly
+  (Chan et al.), which is what lets coarse buckets be built from fine ones.
+
+  NAU7802_SlidingStats covers the last N samples and NAU7802_TumblingStats
+  back to back blocks of N samples or of a fixed duration. Both update in
+  constant time; the sliding window keeps only the samples inside it and
+  the tumbling window keeps none. NAU7802_DeviceStats bundles a running
+  total with one of each for a device.
+
+  NAU7802_Rollup keeps per-device trend buckets at 1 second, 1 minute and
+  1 hour resolution in fixed size rings. Each sample touches only the open
+  1 second bucket; a closed bucket is merged into its parent once. Queries
+  read the rings and never need the raw samples.
+*/
+
+#ifndef _NAU7802_Stats_h
+#define _NAU7802_Stats_h
+
+#include <stdint.h>
+#include <math.h>
+
+#include "NAU7802_Sample.h"
+
+//Single pass count, mean, variance, skewness, min and max
+struct NAU7802_Welford
+{
+  uint64_t count;
+  double mean;
+  double m2; //Sum of squared differences from the mean
+  double m3; //Sum of cubed differences from the mean
+  double min;
+  double max;
+
+  void clear()
+  {
+    count = 0;
+    mean = 0;
+    m2 = 0;
+    m3 = 0;
+    min = 0;
+    max = 0;
+  }
+
+  void add(double x)
+  {
+    uint64_t previous = count;
+    count++;
+    double delta = x - mean;
+    double deltaN = delta / count;
+    double term = delta * deltaN * previous;
+    mean += deltaN;
+    m3 += term * deltaN * (count - 2.0) - 3 * deltaN * m2;
+    m2 += term;
+    if (count == 1 || x < min)
+      min = x;
+    if (count == 1 || x > max)
+      max = x;
+  }
+
+  //Combine with statistics gathered over a disjoint set of samples
+  void merge(const NAU7802_Welford &other)
+  {
+    if (other.count == 0)
+      return;
+    if (count == 0)
+    {
+      *this = other;
+      return;
+    }
+    double na = count, nb = other.count, n = na + nb;
+    double delta = other.mean - mean;
+    m3 += other.m3 + delta * delta * delta * na * nb * (na - nb) / (n * n) + 3 * delta * (na * other.m2 - nb * m2) / n;
+    m2 += other.m2 + delta * delta * (na * nb / n);
+    mean += delta * nb / n;
+    uint64_t total = count + other.count;
+    if (other.min < min)
+      min = other.min;
+    if (other.max > max)
+      max = other.max;
+    count = total;
+  }
+
+  double variance() const //Sample variance
+  {
+    return (count > 1) ? m2 / (count - 1) : 0;
+  }
+
+  double skewness() const //Population skewness, 0 when undefined
+  {
+    return (count > 2 && m2 > 0) ? sqrt((double)count) * m3 / pow(m2, 1.5) : 0;
+  }
+};
+
+//Statistics over the last N samples
+class NAU7802_SlidingStats
+{
+public:
+  NAU7802_SlidingStats(uint32_t window);
+  ~NAU7802_SlidingStats();
+
+  void add(double x); //Constant time amortized
+  void clear();
+  NAU7802_Welford getStats(); //Statistics of the samples currently in the window
+  uint32_t getWindow();
+
+private:
+  void recenter();
+
+  double *values; //Ring of the samples inside the window
+  uint32_t window;
+  uint32_t count;
+  uint32_t next;
+  uint32_t sinceRecenter;
+
+  //Power sums of (x - shift), recomputed from the ring once per window to bound rounding drift
+  double shift;
+  double s1, s2, s3;
+
+  //Monotonic queues of sample numbers for min and max
+  uint64_t *minQueue;
+  uint64_t *maxQueue;
+  uint32_t minHead, minCount;
+  uint32_t maxHead, maxCount;
+  uint64_t added; //Samples ever added. Sample n lives at values[n % window]
+};
+
+//Statistics over back to back blocks of a fixed sample count or duration
+class NAU7802_TumblingStats
+{
+public:
+  NAU7802_TumblingStats(uint32_t samples, uint64_t duration_us = 0); //Either limit may be 0 to disable it
+
+  bool add(const NAU7802_Sample &sample); //Returns true when this sample completed a block
+  void clear();
+  NAU7802_Welford getCurrent();  //Block in progress
+  NAU7802_Welford getLast();     //Most recently completed block
+  uint64_t getLastStart();       //Timestamp of the first sample in the completed block
+  uint32_t getBlockCount();      //Blocks completed
+
+private:
+  uint32_t samples;
+  uint64_t duration_us;
+  uint64_t start_us;
+  NAU7802_Welford current;
+  NAU7802_Welford last;
+  uint64_t lastStart_us;
+  uint32_t blocks;
+};
+
+//Everything tracked for one device
+class NAU7802_DeviceStats
+{
+public:
+  NAU7802_DeviceStats(uint32_t slidingWindow, uint32_t tumblingSamples, uint64_t tumblingDuration_us = 0);
+
+  bool add(const NAU7802_Sample &sample); //Returns true when a tumbling block completed. Samples with a rejectMask flag are only counted
+  void clear();
+
+  uint8_t rejectMask; //NAU7802_FLAG_ bits that keep a sample out of the statistics. 0 takes everything
+  uint64_t rejected;  //Samples left out because of rejectMask
+  NAU7802_Welford total; //Since construction or clear()
+  NAU7802_SlidingStats sliding;
+  NAU7802_TumblingStats tumbling;
+};
+
+//Rollup resolutions
+typedef enum
+{
+  NAU7802_ROLLUP_SECOND = 0,
+  NAU7802_ROLLUP_MINUTE,
+  NAU7802_ROLLUP_HOUR,
+  NAU7802_ROLLUP_LEVELS,
+} NAU7802_Rollup_Level;
+
+//One time bucket of a rollup
+struct NAU7802_Rollup_Bucket
+{
+  uint64_t start_us; //Steady clock start of the bucket
+  NAU7802_Welford stats;
+};
+
+class NAU7802_Rollup
+{
+public:
+  NAU7802_Rollup(uint16_t seconds = 600, uint16_t minutes = 1440, uint16_t hours = 720); //Buckets kept at each resolution
+  ~NAU7802_Rollup();
+
+  void add(const NAU7802_Sample &sample); //Constant time, no allocation
+  void clear();
+
+  uint16_t getBucketCount(NAU7802_Rollup_Level level);                              //Buckets currently held, including the open one
+  bool getBucket(NAU7802_Rollup_Level level, uint16_t age, NAU7802_Rollup_Bucket &out); //age 0 is the open bucket
+  bool summarize(NAU7802_Rollup_Level level, uint64_t from_us, uint64_t to_us, NAU7802_Welford &out); //Merge all held buckets starting in [from, to)
+
+private:
+  void open(uint8_t level, uint64_t index);
+  void close(uint8_t level);
+
+  NAU7802_Rollup_Bucket *rings[NAU7802_ROLLUP_LEVELS];
+  uint16_t capacity[NAU7802_ROLLUP_LEVELS];
+  uint16_t head[NAU7802_ROLLUP_LEVELS];   //Slot of the open bucket
+  uint16_t filled[NAU7802_ROLLUP_LEVELS]; //Buckets held
+  uint64_t index[NAU7802_ROLLUP_LEVELS];  //Open bucket's start divided by its width
+};
+
+#endif
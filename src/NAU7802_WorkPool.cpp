@@ -0,0 +1,141 @@
+/*
+  Small work stealing thread pool for NAU7802 post processing.
+  See NAU7802_WorkPool.h for the design.
+*/
+
+#include "NAU7802_WorkPool.h"
+
+//Index of the pool worker running on this thread, or -1 for outside threads
+static thread_local int currentWorker = -1;
+static thread_local NAU7802_WorkPool *currentPool = nullptr;
+
+NAU7802_WorkPool::NAU7802_WorkPool(uint8_t threadCount)
+{
+  if (threadCount == 0)
+  {
+    unsigned cores = std::thread::hardware_concurrency();
+    threadCount = (cores == 0) ? 2 : (cores > 255 ? 255 : cores);
+  }
+
+  nextWorker = 0;
+  pending = 0;
+  steals = 0;
+  stopping = false;
+
+  for (uint8_t x = 0; x < threadCount; x++)
+    workers.push_back(new Worker);
+  for (uint8_t x = 0; x < threadCount; x++)
+    threads.emplace_back(&NAU7802_WorkPool::run, this, x);
+}
+
+NAU7802_WorkPool::~NAU7802_WorkPool()
+{
+  waitIdle();
+  {
+    std::lock_guard<std::mutex> guard(sleepLock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (size_t x = 0; x < threads.size(); x++)
+    threads[x].join();
+  for (size_t x = 0; x < workers.size(); x++)
+    delete workers[x];
+}
+
+//Queue a task. From a pool worker it lands on that worker's own deque.
+void NAU7802_WorkPool::submit(std::function<void()> task)
+{
+  size_t target;
+  if (currentPool == this && currentWorker >= 0)
+    target = currentWorker;
+  else
+    target = nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+
+  pending.fetch_add(1);
+  {
+    std::lock_guard<std::mutex> guard(workers[target]->lock);
+    workers[target]->tasks.push_back(std::move(task));
+  }
+
+  //Take the sleep lock so a worker about to wait can't miss this wakeup
+  {
+    std::lock_guard<std::mutex> guard(sleepLock);
+  }
+  wake.notify_one();
+}
+
+//Block until every task submitted so far (and any they submit) has run
+void NAU7802_WorkPool::waitIdle()
+{
+  std::unique_lock<std::mutex> guard(sleepLock);
+  idle.wait(guard, [this] { return pending.load() == 0; });
+}
+
+uint8_t NAU7802_WorkPool::getThreadCount()
+{
+  return (threads.size());
+}
+
+uint64_t NAU7802_WorkPool::getStealCount()
+{
+  return (steals.load(std::memory_order_relaxed));
+}
+
+//Pop from our own deque first, then steal the oldest task from the others
+bool NAU7802_WorkPool::take(uint8_t self, std::function<void()> &task)
+{
+  {
+    Worker *own = workers[self];
+    std::lock_guard<std::mutex> guard(own->lock);
+    if (own->tasks.empty() == false)
+    {
+      task = std::move(own->tasks.back());
+      own->tasks.pop_back();
+      return (true);
+    }
+  }
+
+  for (size_t x = 1; x < workers.size(); x++)
+  {
+    Worker *victim = workers[(self + x) % workers.size()];
+    std::lock_guard<std::mutex> guard(victim->lock);
+    if (victim->tasks.empty() == false)
+    {
+      task = std::move(victim->tasks.front());
+      victim->tasks.pop_front();
+      steals.fetch_add(1, std::memory_order_relaxed);
+      return (true);
+    }
+  }
+  return (false);
+}
+
+void NAU7802_WorkPool::run(uint8_t self)
+{
+  currentWorker = self;
+  currentPool = this;
+
+  std::function<void()> task;
+  while (1)
+  {
+    if (take(self, task))
+    {
+      task();
+      task = nullptr;
+      if (pending.fetch_sub(1) == 1)
+      {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        idle.notify_all();
+      }
+      continue;
+    }
+
+    std::unique_lock<std::mutex> guard(sleepLock);
+    if (stopping)
+      break;
+    //Timed wait covers tasks queued between take() and taking the lock
+    wake.wait_for(guard, std::chrono::milliseconds(10));
+    if (stopping && pending.load() == 0)
+      break;
+  }
+}
@@ -0,0 +1,56 @@
+/*
+  Small work stealing thread pool for NAU7802 post processing.
+
+  Each worker owns a deque. Tasks submitted from a worker go to the back of
+  its own deque and are popped from the back (newest first, still warm in
+  cache). Tasks submitted from other threads are spread round robin. An idle
+  worker steals from the front of the other deques, so one expensive stage
+  (a long median, dynamic weighing) can't pile work up behind a single
+  thread while others sit idle.
+*/
+
+#ifndef _NAU7802_WorkPool_h
+#define _NAU7802_WorkPool_h
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class NAU7802_WorkPool
+{
+public:
+  NAU7802_WorkPool(uint8_t threads = 0); //0 picks one thread per hardware core
+  ~NAU7802_WorkPool();                   //Finishes queued tasks, then joins the workers
+
+  void submit(std::function<void()> task); //Queue a task. Safe from any thread
+  void waitIdle();                         //Block until every queued task has run
+  uint8_t getThreadCount();
+  uint64_t getStealCount(); //Tasks that ran on a worker other than the one they were queued on
+
+private:
+  struct Worker
+  {
+    std::mutex lock;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void run(uint8_t self);
+  bool take(uint8_t self, std::function<void()> &task);
+
+  std::vector<Worker *> workers;
+  std::vector<std::thread> threads;
+  std::atomic<uint32_t> nextWorker;
+  std::atomic<uint64_t> pending;
+  std::atomic<uint64_t> steals;
+  std::atomic<bool> stopping;
+  std::mutex sleepLock;
+  std::condition_variable wake;
+  std::condition_variable idle;
+};
+
+#endif
@@ -0,0 +1,90 @@
+/*
+  NAU7802_ClockEstimator against simulated readers.
+  Build and run with "make test".
+*/
+
+#include "../src/NAU7802_Clock.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static int failures = 0;
+
+static void check(bool condition, const char *what)
+{
+  if (condition == false)
+  {
+    printf("FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+//Read an ADC converting every adcPeriod_us at readPeriod_us intervals, each read up to
+//jitter_us late. Returns conversions the reader never saw.
+static uint64_t run(NAU7802_ClockEstimator &clock, double adcPeriod_us, double readPeriod_us, uint32_t jitter_us, uint32_t reads, double &worstError_us)
+{
+  double start_us = 1000000;
+  uint64_t lastConversion = 0;
+  uint64_t missed = 0;
+  worstError_us = 0;
+  srand(1);
+  for (uint32_t x = 0; x < reads; x++)
+  {
+    double read_us = start_us + 200 + x * readPeriod_us + (jitter_us ? rand() % jitter_us : 0);
+    uint64_t conversion = (uint64_t)floor((read_us - start_us) / adcPeriod_us); //Newest one done
+    if (x > 0 && conversion > lastConversion + 1)
+      missed += conversion - lastConversion - 1;
+    lastConversion = conversion;
+
+    double converted_us = start_us + conversion * adcPeriod_us;
+    double error = (double)clock.update((uint64_t)read_us) - converted_us;
+    if (x > reads / 2 && fabs(error) > worstError_us)
+      worstError_us = fabs(error);
+  }
+  return (missed);
+}
+
+int main()
+{
+  double error;
+
+  //Reader keeping up, ADC 0.2% slow against nominal
+  NAU7802_ClockEstimator steady(3125);
+  uint64_t missed = run(steady, 3131.25, 3131.25, 100, 2000, error);
+  check(missed == 0 && steady.getSkipped() == 0, "steady reader skips nothing");
+  check(fabs(steady.getPeriod() - 3131.25) < 1, "steady reader finds the ADC period");
+  check(fabs(steady.getDriftPpm() - 2000) < 300, "steady reader finds the drift");
+  check(error < 400, "steady reader timestamps sit on the conversions");
+
+  //Reader keeping up with an ADC at the edge of its tolerance, lots of jitter
+  NAU7802_ClockEstimator noisy(12500);
+  missed = run(noisy, 12600, 12600, 500, 2000, error);
+  check(missed == 0 && noisy.getSkipped() == 0, "noisy reader skips nothing");
+  check(fabs(noisy.getPeriod() - 12600) < 2, "noisy reader finds the ADC period");
+
+  //Reader slower than the ADC: conversions are overwritten and the fit must stay on the ADC
+  NAU7802_ClockEstimator slow(3125);
+  missed = run(slow, 3125, 3185, 20, 2000, error);
+  check(missed > 30, "slow reader loses conversions");
+  check(slow.getSkipped() == missed, "slow reader counts every lost conversion");
+  check(fabs(slow.getPeriod() - 3125) < 1, "slow reader still finds the ADC period");
+  check(slow.getLate() > 0, "slow reads are kept out of the fit");
+  check(error < 3125, "slow reader timestamps stay within a conversion");
+
+  //Much slower reader
+  NAU7802_ClockEstimator slower(3125);
+  missed = run(slower, 3125, 4000, 50, 2000, error);
+  check(slower.getSkipped() == missed, "slower reader counts every lost conversion");
+  check(fabs(slower.getPeriod() - 3125) < 1, "slower reader still finds the ADC period");
+
+  //Reader at half the ADC rate
+  NAU7802_ClockEstimator half(12500);
+  missed = run(half, 12500, 25000, 100, 1000, error);
+  check(half.getSkipped() == missed && missed == 999, "half rate reader counts every other conversion");
+  check(fabs(half.getPeriod() - 12500) < 2, "half rate reader finds the ADC period");
+
+  if (failures == 0)
+    printf("Test_Clock passed\n");
+  return (failures == 0 ? 0 : 1);
+}
@@ -0,0 +1,86 @@
+/*
+  NAU7802_PackedRing history reads.
+  Build and run with "make test".
+*/
+
+#include "../src/NAU7802_Packed.h"
+
+#include <stdio.h>
+#include <vector>
+
+static int failures = 0;
+
+static void check(bool condition, const char *what)
+{
+  if (condition == false)
+  {
+    printf("FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+static NAU7802_Sample sample(uint16_t device, uint32_t sequence)
+{
+  NAU7802_Sample s = {};
+  s.timestamp_us = 1000000 + (uint64_t)sequence * 12500;
+  s.value = (int32_t)sequence * 3 - 500;
+  s.device = device;
+  s.sequence = sequence;
+  return (s);
+}
+
+//out must be the newest count samples fed, oldest first
+static void checkLatest(NAU7802_PackedRing &ring, uint32_t fed, size_t maxSamples, size_t expected, const char *what)
+{
+  std::vector<NAU7802_Sample> out(maxSamples);
+  size_t count = ring.readLatest(out.data(), maxSamples);
+  check(count == expected, what);
+  for (size_t x = 0; x < count; x++)
+  {
+    NAU7802_Sample want = sample(1, fed - count + x);
+    check(out[x].sequence == want.sequence && out[x].value == want.value &&
+              out[x].timestamp_us == want.timestamp_us && out[x].device == 1,
+          what);
+  }
+}
+
+int main()
+{
+  std::vector<uint8_t> memory(NAU7802_PackedRing::getRequiredBytes(4, 128));
+  NAU7802_PackedRing ring(memory.data(), memory.size(), 4, 128);
+  check(ring.isValid(), "ring formats");
+
+  //All within the one open block
+  uint32_t fed = 0;
+  for (; fed < 100; fed++)
+    ring.add(sample(1, fed));
+  checkLatest(ring, fed, 10, 10, "tail of one block");
+  checkLatest(ring, fed, 100, 100, "whole block");
+  checkLatest(ring, fed, 200, 100, "more than held");
+
+  //Spread over several blocks, the oldest only partly wanted
+  for (; fed < 300; fed++)
+    ring.add(sample(1, fed));
+  check(ring.getBlocksStarted() == 3, "blocks open as they fill");
+  checkLatest(ring, fed, 10, 10, "tail of the open block");
+  checkLatest(ring, fed, 50, 50, "across a block boundary");
+  checkLatest(ring, fed, 250, 250, "across three blocks");
+
+  //Old blocks have been reused; only what the ring holds comes back
+  for (; fed < 1000; fed++)
+    ring.add(sample(1, fed));
+  checkLatest(ring, fed, 1000, 1000 - 128 * 4, "after wrapping");
+
+  //A sequence gap opens a block but readLatest still returns the newest records
+  fed += 5;
+  ring.add(sample(1, fed++));
+  checkLatest(ring, fed, 1, 1, "newest after a gap");
+
+  NAU7802_Sample out[10];
+  size_t count = ring.readBlock(ring.getBlocksStarted() - 3, out, 10, 100);
+  check(count == 10 && out[0].sequence == 128 * 6 + 100, "readBlock from an offset");
+
+  if (failures == 0)
+    printf("Test_Packed passed\n");
+  return (failures == 0 ? 0 : 1);
+}